@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanBloom summarizes the words of a log segment, so that searches can skip the segments that can't match.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/* Opens the filter file, followed by one `BeanBloomSegment` and `filterBytes` of bits per segment. */
+struct BeanBloomHeader
+{
+    static constexpr uint32_t Signature = 0x4D4C4242; // "BBLM"
+
+    uint32_t signature;
+    uint32_t filterBytes;
+    uint32_t hashes;
+    uint32_t reserved;
+};
+
+/* The bytes of the log a filter covers, [`begin`, `end`). */
+struct BeanBloomSegment
+{
+    uint64_t begin;
+    uint64_t end;
+};
+
+class BeanBloom
+{
+public:
+    static constexpr uint32_t Hashes = 4;
+
+    explicit BeanBloom(size_t bytes) : _bits(bytes)
+    {
+    }
+
+    void Add(uint64_t hash) noexcept
+    {
+        const uint64_t count = _bits.size() * 8;
+        for (uint32_t i = 0; i < Hashes; ++i)
+        {
+            const uint64_t bit = _GetBit(hash, i) % count;
+            _bits[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+        }
+    }
+
+    void Clear(void) noexcept
+    {
+        std::fill(_bits.begin(), _bits.end(), uint8_t{0});
+    }
+
+    const std::vector<uint8_t>& GetBits(void) const noexcept
+    {
+        return _bits;
+    }
+
+    /* False only if a word with this hash was never added to the filter in `bits`. */
+    static bool MayContain(const uint8_t* bits, size_t bytes, uint64_t hash) noexcept
+    {
+        const uint64_t count = bytes * 8;
+        for (uint32_t i = 0; i < Hashes; ++i)
+        {
+            const uint64_t bit = _GetBit(hash, i) % count;
+            if (!(bits[bit / 8] & (1 << (bit % 8))))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+        Calls `fn(hash)` for every word in `text`. Words are runs of ASCII letters, digits and underscores
+        and they're compared regardless of case, so text written as UTF-16 and read back as UTF-8 hashes the same.
+    */
+    template <typename CHAR, typename FN>
+    static void ForEachWord(std::basic_string_view<CHAR> text, FN&& fn)
+    {
+        uint64_t hash = _offsetBasis;
+        bool isWord = false;
+        for (const CHAR c : text)
+        {
+            const auto code = static_cast<std::make_unsigned_t<CHAR>>(c);
+            if ((code >= 'a' && code <= 'z') || (code >= '0' && code <= '9') || code == '_')
+            {
+                hash = (hash ^ code) * _prime;
+                isWord = true;
+            }
+            else if (code >= 'A' && code <= 'Z')
+            {
+                hash = (hash ^ (code | 0x20)) * _prime;
+                isWord = true;
+            }
+            else if (isWord)
+            {
+                fn(hash);
+                hash = _offsetBasis;
+                isWord = false;
+            }
+        }
+
+        if (isWord)
+        {
+            fn(hash);
+        }
+    }
+
+private:
+    /* Double hashing, the upper half is the stride and it's odd so that it never repeats a bit early. */
+    static uint64_t _GetBit(uint64_t hash, uint32_t i) noexcept
+    {
+        return hash + i * ((hash >> 32) | 1);
+    }
+
+private:
+    // FNV-1a
+    static constexpr uint64_t _offsetBasis = 0xCBF29CE484222325;
+    static constexpr uint64_t _prime = 0x100000001B3;
+
+    std::vector<uint8_t> _bits;
+};
@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanCapture decides how a message argument travels when the backend formats the message.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include "BeanField.hpp"
+
+/* Numbers are kept by value and wide strings are copied into the record, anything else is formatted on the spot. */
+template <typename T>
+constexpr bool BeanIsCapturable(void) noexcept
+{
+    using Type = std::decay_t<T>;
+    return std::is_arithmetic_v<Type> ||
+           std::is_same_v<Type, BeanField> ||
+           std::is_same_v<Type, const wchar_t*> ||
+           std::is_same_v<Type, wchar_t*> ||
+           std::is_same_v<Type, std::wstring> ||
+           std::is_same_v<Type, std::wstring_view>;
+}
+
+template <typename T>
+using BeanCaptured = std::conditional_t<std::is_arithmetic_v<std::decay_t<T>> || std::is_same_v<std::decay_t<T>, BeanField>, std::decay_t<T>, std::wstring_view>;
+
+/* Strings still point to the caller's memory, the record they're packed into copies them. */
+template <typename T>
+BeanCaptured<T> BeanCapture(const T& arg) noexcept
+{
+    if constexpr (std::is_same_v<std::decay_t<T>, BeanField>)
+    {
+        // Fields are packed on their own, their placeholders only have to format to nothing
+        return BeanField{};
+    }
+    else if constexpr (std::is_arithmetic_v<std::decay_t<T>>)
+    {
+        return arg;
+    }
+    else
+    {
+        return std::wstring_view(arg);
+    }
+}
+
+/* Characters needed to hold copies of every string in `args`. */
+template <typename... CAPTURED>
+size_t BeanCaptureSize(const std::tuple<CAPTURED...>& args) noexcept
+{
+    return std::apply([](const CAPTURED&... arg)
+    {
+        return (size_t{0} + ... + [&]
+        {
+            if constexpr (std::is_same_v<CAPTURED, std::wstring_view>)
+            {
+                return arg.size();
+            }
+            else
+            {
+                return size_t{0};
+            }
+        }());
+    }, args);
+}
@@ -0,0 +1,143 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanCategory gives each subsystem a log level of its own.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string_view>
+
+#include "BeanRecord.hpp"
+#include "BeanSite.hpp"
+
+/*
+    A named subsystem with its own log level, declare them with `bean_declare_category`.
+    Until `SetLevel` is called a category follows the level set with `bean_set_loglevel`,
+    which is resolved when it's set so that checking a level is always a single load.
+*/
+class BeanCategory
+{
+public:
+    explicit BeanCategory(const wchar_t* name) noexcept
+        : _name(name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _level.store(_inherited, std::memory_order_relaxed);
+        _next = _head;
+        _head = this;
+    }
+
+    /* Categories of an unloaded module must not be left dangling in the list. */
+    ~BeanCategory()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (BeanCategory** it = &_head; *it; it = &(*it)->_next)
+        {
+            if (*it == this)
+            {
+                *it = _next;
+                break;
+            }
+        }
+    }
+
+    /* Messages without a category end up here, its level is the one set with `bean_set_loglevel`. */
+    static BeanCategory& Default(void)
+    {
+        static BeanCategory Category(L"default");
+        return Category;
+    }
+
+    static BeanCategory* Find(std::wstring_view name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (BeanCategory* category = _head; category; category = category->_next)
+        {
+            if (name == category->_name)
+            {
+                return category;
+            }
+        }
+        return nullptr;
+    }
+
+    /* Applies `lvl` to every category that doesn't have a level of its own. */
+    static void SetInheritedLevel(BeanLogLevel lvl)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _inherited = lvl;
+        for (BeanCategory* category = _head; category; category = category->_next)
+        {
+            if (!category->_explicit)
+            {
+                category->_level.store(lvl, std::memory_order_relaxed);
+                BeanSites::Refresh(*category, lvl);
+            }
+        }
+    }
+
+    bool IsEnabled(BeanLogLevel lvl) const noexcept
+    {
+        return lvl >= _level.load(std::memory_order_relaxed);
+    }
+
+    BeanLogLevel GetLevel(void) const noexcept
+    {
+        return _level.load(std::memory_order_relaxed);
+    }
+
+    /* Overrides the inherited level. */
+    void SetLevel(BeanLogLevel lvl)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _explicit = true;
+        _level.store(lvl, std::memory_order_relaxed);
+        BeanSites::Refresh(*this, lvl);
+    }
+
+    /* Goes back to following `bean_set_loglevel`. */
+    void ResetLevel(void)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _explicit = false;
+        _level.store(_inherited, std::memory_order_relaxed);
+        BeanSites::Refresh(*this, _inherited);
+    }
+
+    const wchar_t* GetName(void) const noexcept
+    {
+        return _name;
+    }
+
+public:
+    BeanCategory(const BeanCategory&) = delete;
+    BeanCategory(BeanCategory&&) = delete;
+    BeanCategory& operator=(const BeanCategory&) = delete;
+    BeanCategory& operator=(BeanCategory&&) = delete;
+
+private:
+    static inline std::mutex _mutex;
+    static inline BeanCategory* _head = nullptr;
+    static inline BeanLogLevel _inherited = BeanLogLevel::trace;
+
+    const wchar_t* _name;
+    std::atomic<BeanLogLevel> _level = BeanLogLevel::trace;
+    bool _explicit = false;
+    BeanCategory* _next = nullptr;
+};
+
+inline BeanLogSite::BeanLogSite(const BeanCategory& category, BeanLogLevel level, const wchar_t* file, int line, const wchar_t* function, const wchar_t* format)
+    : _category(category), _level(level), _file(file), _line(line), _function(function), _format(format)
+{
+    BeanSites::Add(*this);
+}
+
+inline BeanLogLevel BeanSites::_GetCategoryLevel(const BeanLogSite& site) noexcept
+{
+    return site._category.GetLevel();
+}
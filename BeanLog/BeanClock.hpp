@@ -0,0 +1,248 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanClock turns cheap raw ticks, taken by producers, into wall-clock time.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+/* Either way, timestamps are the system clock's: ticks are anchored to it every `_resyncPeriod`. */
+enum class BeanClockSource
+{
+    system, // `std::chrono::steady_clock`
+    tsc     // `rdtsc`, converted at output
+};
+
+/* Converts system time to local time, the time zone database is only hit when the offset may change. Not thread safe. */
+class BeanTimeZone
+{
+public:
+    using LocalTime = std::chrono::local_time<std::chrono::system_clock::duration>;
+
+    LocalTime ToLocal(std::chrono::system_clock::time_point sys)
+    {
+        // Offsets only change on zone transitions, there's no need to hit the tz database every time.
+        // Compared in seconds, the bounds of zones without transitions overflow finer durations
+        const auto seconds = std::chrono::floor<std::chrono::seconds>(sys);
+        if (seconds < _begin || seconds >= _end)
+        {
+            const auto zoneInfo = std::chrono::current_zone()->get_info(sys);
+            _offset = zoneInfo.offset;
+            _begin = zoneInfo.begin;
+            _end = zoneInfo.end;
+        }
+
+        return LocalTime{(sys + _offset).time_since_epoch()};
+    }
+
+private:
+    std::chrono::seconds _offset{};
+
+    // Parenthesized, `<Windows.h>` defines `min` and `max` macros unless the application defines NOMINMAX
+    std::chrono::sys_seconds _begin = (std::chrono::sys_seconds::max)();
+    std::chrono::sys_seconds _end = (std::chrono::sys_seconds::min)();
+};
+
+class BeanClock
+{
+public:
+    using SysTime = std::chrono::sys_time<std::chrono::nanoseconds>;
+    using LocalTime = BeanTimeZone::LocalTime;
+
+private:
+    enum class _Kind
+    {
+        steady,
+        tsc
+    };
+
+public:
+    /* A tick source along with the baseline its rate is measured from, see `Measure`. */
+    struct Source
+    {
+        _Kind kind = _Kind::steady;
+        uint64_t baseTicks = 0;
+        std::chrono::steady_clock::time_point baseSteady{};
+    };
+
+    BeanClock()
+    {
+        SetSource(Measure(BeanClockSource::system));
+    }
+
+    /*
+        Takes a first estimate of a source's rate, requesting the TSC falls back to `std::chrono::steady_clock`
+        when the processor doesn't advertise an invariant TSC. The TSC takes a couple of milliseconds of
+        spinning, nothing of the clock is touched so that it can be done before locking anything.
+    */
+    static Source Measure(BeanClockSource src)
+    {
+        Source source;
+        if (src == BeanClockSource::tsc && _IsTscInvariant())
+        {
+            // Only a first estimate, every `_Resync` refines it over an ever growing baseline
+            source.kind = _Kind::tsc;
+            source.baseSteady = std::chrono::steady_clock::now();
+            source.baseTicks = _Read(_Kind::tsc);
+            while (std::chrono::steady_clock::now() - source.baseSteady < std::chrono::milliseconds(2))
+            {
+            }
+        }
+        return source;
+    }
+
+    /*
+        Selects the tick source used by `Now` and anchors it to the system clock. Not thread safe, the caller
+        serializes it with conversions, nor meant to be called while other threads are logging.
+    */
+    void SetSource(const Source& source)
+    {
+        _kind.store(source.kind, std::memory_order_relaxed);
+        _baseTicks = source.baseTicks;
+        _baseSteady = source.baseSteady;
+        if (source.kind == _Kind::steady)
+        {
+            _ticksPerSecond = static_cast<double>(std::chrono::steady_clock::period::den) / std::chrono::steady_clock::period::num;
+        }
+
+        _Resync();
+    }
+
+    /* Loads the time zone database ahead of the first `ToLocalTime`, safe to call from any thread. */
+    static void Preload(void) noexcept
+    {
+        try
+        {
+            std::chrono::current_zone();
+        }
+        catch (...)
+        {
+            // The first `ToLocalTime` runs into the same problem and reports it
+        }
+    }
+
+    /*
+        Reads the raw tick counter, this is the only clock work left on the producer path. Ticks never go
+        backwards, whatever the source: the system clock only anchors them once they're converted.
+    */
+    uint64_t Now(void) const noexcept
+    {
+        return _Read(_kind.load(std::memory_order_relaxed));
+    }
+
+    /* Length of a tick as of the last calibration. */
+    double NanosecondsPerTick(void) const noexcept
+    {
+        return _nsPerTick;
+    }
+
+    /* Converts a difference of ticks, durations never go through the system clock. */
+    std::chrono::nanoseconds ToDuration(uint64_t ticks) const noexcept
+    {
+        return std::chrono::nanoseconds(std::llround(static_cast<double>(ticks) * _nsPerTick));
+    }
+
+    /* Converts raw ticks to system time. Not thread safe, the caller serializes conversions. */
+    SysTime ToSysTime(uint64_t ticks)
+    {
+        // Anchor the calibration again once it's older than `_resyncPeriod`
+        if (static_cast<int64_t>(ticks - _anchorTicks) > static_cast<int64_t>(_resyncTicks))
+        {
+            _Resync();
+        }
+
+        const auto delta = static_cast<double>(static_cast<int64_t>(ticks - _anchorTicks));
+        return _anchorSys + std::chrono::nanoseconds(std::llround(delta * _nsPerTick));
+    }
+
+    /* Converts raw ticks to local time, same rules as `ToSysTime` apply. */
+    LocalTime ToLocalTime(uint64_t ticks)
+    {
+        return _zone.ToLocal(std::chrono::time_point_cast<std::chrono::system_clock::duration>(ToSysTime(ticks)));
+    }
+
+private:
+    static uint64_t _Read(_Kind kind) noexcept
+    {
+        switch (kind)
+        {
+#if defined(_M_X64) || defined(_M_IX86)
+            case _Kind::tsc:
+            {
+                return __rdtsc();
+            }
+#endif
+            default:
+            case _Kind::steady:
+            {
+                return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+            }
+        }
+    }
+
+    /* An invariant TSC ticks at a constant rate across P/C-states and cores (CPUID.80000007H:EDX[8]). */
+    static bool _IsTscInvariant(void)
+    {
+#if defined(_M_X64) || defined(_M_IX86)
+        int regs[4]{};
+        __cpuid(regs, 0x80000000);
+        if (static_cast<unsigned>(regs[0]) < 0x80000007)
+        {
+            return false;
+        }
+
+        __cpuid(regs, 0x80000007);
+        return (regs[3] & (1 << 8)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    /* Re-anchors ticks to the system clock, which may have been adjusted in the meantime. */
+    void _Resync(void)
+    {
+        const auto steadyNow = std::chrono::steady_clock::now();
+        const auto sysNow = std::chrono::system_clock::now();
+        const _Kind kind = _kind.load(std::memory_order_relaxed);
+        const uint64_t ticks = _Read(kind);
+
+        // The TSC rate is measured against the steady clock so that wall-clock adjustments don't skew it
+        if (kind == _Kind::tsc)
+        {
+            const double elapsed = std::chrono::duration<double>(steadyNow - _baseSteady).count();
+            if (elapsed > 0.0)
+            {
+                _ticksPerSecond = static_cast<double>(ticks - _baseTicks) / elapsed;
+            }
+        }
+
+        _nsPerTick = 1e9 / _ticksPerSecond;
+        _resyncTicks = static_cast<uint64_t>(_ticksPerSecond * _resyncPeriod.count());
+        _anchorTicks = ticks;
+        _anchorSys = std::chrono::time_point_cast<std::chrono::nanoseconds>(sysNow);
+    }
+
+private:
+    static constexpr std::chrono::duration<double> _resyncPeriod{1.0};
+
+    std::atomic<_Kind> _kind = _Kind::steady;
+    double _ticksPerSecond = 1.0;
+    double _nsPerTick = 1.0;
+    uint64_t _resyncTicks = 0;
+    uint64_t _anchorTicks = 0;
+    SysTime _anchorSys{};
+    uint64_t _baseTicks = 0;
+    std::chrono::steady_clock::time_point _baseSteady{};
+    BeanTimeZone _zone;
+};
@@ -0,0 +1,188 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanContext attaches a thread's diagnostic context to the messages it logs.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+#include "BeanField.hpp"
+
+/*
+    A stack of fields kept per thread. Entries are appended to a ring and never modified afterwards,
+    so a record only has to remember the sequence number of the innermost one, and whoever writes it
+    out walks the chain back. Entries the ring has wrapped over by then are left out.
+*/
+class BeanContext
+{
+    struct _Entry;
+
+public:
+    static constexpr size_t capacity = 512;
+    static constexpr size_t maxDepth = 16;
+    static constexpr size_t maxText = 48;
+
+    /* What `Collect` copies out of the ring, string values point into it. */
+    class Snapshot
+    {
+    public:
+        std::span<const BeanField> GetFields(void) const noexcept
+        {
+            return {_fields, _count};
+        }
+
+    private:
+        friend class BeanContext;
+
+        BeanField _fields[maxDepth];
+        wchar_t _text[maxDepth][maxText];
+        size_t _count = 0;
+    };
+
+    /* Owner thread only, string values longer than `maxText` are cut short and fields deeper than `maxDepth` are left out. */
+    void Push(const BeanField& field) noexcept
+    {
+        if (_depth++ >= maxDepth)
+        {
+            return;
+        }
+
+        // The enclosing entries are copied forward before the ring wraps over them, sequence numbers only grow
+        if (_depth > 1 && _head.load(std::memory_order_relaxed) + 1 - _stack[0] >= capacity - maxDepth)
+        {
+            uint64_t parent = 0;
+            for (size_t i = 0; i + 1 < _depth; ++i)
+            {
+                _Entry entry = _Load(_stack[i]);
+                entry.parent = parent;
+                _stack[i] = _Append(entry);
+                parent = _stack[i];
+            }
+        }
+
+        _Entry entry{field, _depth > 1 ? _stack[_depth - 2] : 0};
+        if (field.value.type == BeanValueType::string)
+        {
+            entry.length = (std::min)(field.value.string.size(), maxText);
+            std::copy_n(field.value.string.data(), entry.length, entry.text);
+            entry.field.value.string = {};
+        }
+        _stack[_depth - 1] = _Append(entry);
+    }
+
+    /* Owner thread only. */
+    void Pop(void) noexcept
+    {
+        if (_depth)
+        {
+            --_depth;
+        }
+    }
+
+    /* Owner thread only, what a record keeps of the context. Zero means there's none. */
+    uint64_t GetTop(void) const noexcept
+    {
+        return _depth ? _stack[(std::min)(_depth, maxDepth) - 1] : 0;
+    }
+
+    /* Copies the context as it was at `top`, outermost first. Callable from any thread. */
+    void Collect(uint64_t top, Snapshot& snapshot) const noexcept
+    {
+        snapshot._count = 0;
+        for (uint64_t seq = top; seq && snapshot._count < maxDepth;)
+        {
+            const _Entry entry = _Load(seq);
+
+            // Checked after copying, the owner may have wrapped over the entry while it was being read
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_head.load(std::memory_order_relaxed) - seq >= capacity)
+            {
+                break;
+            }
+
+            BeanField& field = snapshot._fields[snapshot._count];
+            field = entry.field;
+            if (field.value.type == BeanValueType::string)
+            {
+                std::copy_n(entry.text, entry.length, snapshot._text[snapshot._count]);
+                field.value.string = {snapshot._text[snapshot._count], entry.length};
+            }
+
+            ++snapshot._count;
+            seq = entry.parent;
+        }
+
+        std::reverse(snapshot._fields, snapshot._fields + snapshot._count);
+    }
+
+private:
+    // String values live in `text`, the view itself is left empty
+    struct _Entry
+    {
+        BeanField field;
+        uint64_t parent = 0;
+        size_t length = 0;
+        wchar_t text[maxText]{};
+    };
+
+    // Readers may race with the owner wrapping over a slot, so slots are copied in and out a word at a time
+    static_assert(std::is_trivially_copyable_v<BeanField>, "Context entries are copied word by word.");
+    static constexpr size_t _slotWords = (sizeof(_Entry) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    struct _Slot
+    {
+        std::atomic<uint64_t> words[_slotWords];
+    };
+
+    /* The sequence number is published before the slot is overwritten, a reader that sees any of the new words also sees it. */
+    uint64_t _Append(const _Entry& entry) noexcept
+    {
+        const uint64_t seq = _head.load(std::memory_order_relaxed) + 1;
+        _head.store(seq, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint64_t words[_slotWords]{};
+        std::memcpy(words, &entry, sizeof(_Entry));
+
+        _Slot& slot = _slots[seq & (capacity - 1)];
+        for (size_t i = 0; i < _slotWords; ++i)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        return seq;
+    }
+
+    _Entry _Load(uint64_t seq) const noexcept
+    {
+        const _Slot& slot = _slots[seq & (capacity - 1)];
+
+        uint64_t words[_slotWords];
+        for (size_t i = 0; i < _slotWords; ++i)
+        {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+
+        _Entry entry;
+        std::memcpy(&entry, words, sizeof(_Entry));
+
+        // Torn lengths are thrown away by the caller, they just mustn't overflow anything before that
+        entry.length = (std::min)(entry.length, maxText);
+        return entry;
+    }
+
+private:
+    _Slot _slots[capacity]{};
+    uint64_t _stack[maxDepth]{};
+    size_t _depth = 0;
+    std::atomic<uint64_t> _head = 0;
+};
@@ -0,0 +1,132 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanField carries a structured key-value pair along with a log message.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+enum class BeanValueType : uint8_t
+{
+    boolean,
+    int64,
+    uint64,
+    float64,
+    string
+};
+
+/* A typed value, kept as is until an encoder writes it out. Strings aren't owned. */
+struct BeanValue
+{
+    BeanValueType type = BeanValueType::int64;
+    union
+    {
+        bool boolean;
+        int64_t int64 = 0;
+        uint64_t uint64;
+        double float64;
+    };
+    std::wstring_view string;
+};
+
+struct BeanField
+{
+    const char* key = "";
+    BeanValue value;
+
+    /* Characters needed to hold copies of every string value in `fields`. */
+    static size_t StringSize(std::span<const BeanField> fields) noexcept
+    {
+        size_t size = 0;
+        for (const BeanField& field : fields)
+        {
+            if (field.value.type == BeanValueType::string)
+            {
+                size += field.value.string.size();
+            }
+        }
+        return size;
+    }
+
+    /* Copies `fields` to `out` and their strings to `storage`, see `StringSize`. Keys must be literals. */
+    static void Copy(std::span<const BeanField> fields, BeanField* out, wchar_t* storage) noexcept
+    {
+        for (const BeanField& field : fields)
+        {
+            *out = field;
+            if (field.value.type == BeanValueType::string)
+            {
+                out->value.string = {storage, field.value.string.size()};
+                storage = std::copy(field.value.string.begin(), field.value.string.end(), storage);
+            }
+            ++out;
+        }
+    }
+};
+
+/*
+    Captures `value` under `key` without formatting it, pass it to any `bean_*` macro after the
+    format string's own arguments. Strings are only referenced, they need to outlive the call.
+*/
+template <typename T>
+BeanField kv(const char* key, const T& value) noexcept
+{
+    BeanField field{key};
+    if constexpr (std::is_same_v<T, bool>)
+    {
+        field.value.type = BeanValueType::boolean;
+        field.value.boolean = value;
+    }
+    else if constexpr (std::is_enum_v<T>)
+    {
+        field.value.type = BeanValueType::int64;
+        field.value.int64 = static_cast<int64_t>(value);
+    }
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+    {
+        field.value.type = BeanValueType::int64;
+        field.value.int64 = value;
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+        field.value.type = BeanValueType::uint64;
+        field.value.uint64 = value;
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        field.value.type = BeanValueType::float64;
+        field.value.float64 = value;
+    }
+    else
+    {
+        static_assert(std::is_convertible_v<const T&, std::wstring_view>, "kv() takes booleans, numbers, enums and wide strings.");
+        field.value.type = BeanValueType::string;
+        field.value.string = value;
+    }
+    return field;
+}
+
+/* Fields travel along with the format arguments, they just don't show up in the message. */
+template <>
+struct std::formatter<BeanField, wchar_t>
+{
+    constexpr auto parse(std::wformat_parse_context& ctx)
+    {
+        return ctx.begin();
+    }
+
+    auto format(const BeanField&, std::wformat_context& ctx) const
+    {
+        return ctx.out();
+    }
+};
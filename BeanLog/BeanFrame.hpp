@@ -0,0 +1,170 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanFrame wraps what BeanLog writes to a file in checksummed frames, a crash can only cut the last one short.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+/* CRC32C (Castagnoli), computed with SSE4.2 when the processor has it and with a table otherwise. */
+class BeanCrc32c
+{
+public:
+    /* Continues `crc` over `size` more bytes, start from zero. */
+    static uint32_t Update(uint32_t crc, const void* data, size_t size) noexcept
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        uint32_t state = ~crc;
+
+#if defined(_M_X64)
+        static const bool IsHardware = _IsHardware();
+        if (IsHardware)
+        {
+            uint64_t wide = state;
+            for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t))
+            {
+                uint64_t word;
+                memcpy(&word, bytes, sizeof(word));
+                wide = _mm_crc32_u64(wide, word);
+            }
+            state = static_cast<uint32_t>(wide);
+            for (; size; ++bytes, --size)
+            {
+                state = _mm_crc32_u8(state, *bytes);
+            }
+            return ~state;
+        }
+#endif
+
+        // Reflected polynomial 0x1EDC6F41, one byte at a time
+        static constexpr std::array<uint32_t, 256> Table = []
+        {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+                }
+                table[i] = crc;
+            }
+            return table;
+        }();
+        for (; size; ++bytes, --size)
+        {
+            state = Table[(state ^ *bytes) & 0xFF] ^ (state >> 8);
+        }
+        return ~state;
+    }
+
+private:
+    /* SSE4.2 is advertised by CPUID.01H:ECX[20]. */
+    static bool _IsHardware(void) noexcept
+    {
+#if defined(_M_X64)
+        int regs[4]{};
+        __cpuid(regs, 1);
+        return (regs[2] & (1 << 20)) != 0;
+#else
+        return false;
+#endif
+    }
+};
+
+/* Precedes every frame's payload, fields are little-endian like everything BeanLog runs on. */
+struct BeanFrameHeader
+{
+    static constexpr uint32_t Signature = 0x4E414542; // "BEAN"
+
+    uint32_t signature;
+    uint32_t length;
+    uint64_t sequence;
+
+    // Covers `length`, `sequence` and the payload, a frame torn by a crash fails it
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(BeanFrameHeader) == 24);
+
+class BeanFrame
+{
+public:
+    /* Appends a frame holding `payload` to `out`, the header and the payload go out in a single write. */
+    static void Append(std::string& out, uint64_t sequence, std::string_view payload)
+    {
+        BeanFrameHeader header{BeanFrameHeader::Signature, static_cast<uint32_t>(payload.size()), sequence, 0, 0};
+        header.checksum = _Checksum(header, payload.data());
+
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.append(payload);
+    }
+
+    /*
+        Size of the frame at the start of `data`, header included, if it's complete and its checksum
+        matches. Zero otherwise, what follows a bad frame can still be found by its signature.
+    */
+    static size_t Check(const char* data, size_t size, BeanFrameHeader& header) noexcept
+    {
+        if (size < sizeof(BeanFrameHeader))
+        {
+            return 0;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (header.signature != BeanFrameHeader::Signature || header.length > size - sizeof(header))
+        {
+            return 0;
+        }
+
+        if (_Checksum(header, data + sizeof(header)) != header.checksum)
+        {
+            return 0;
+        }
+        return sizeof(header) + header.length;
+    }
+
+    /* Offset of the next frame signature at or after `offset`, `size` if there's none. */
+    static size_t Find(const char* data, size_t size, size_t offset) noexcept
+    {
+        const uint32_t signature = BeanFrameHeader::Signature;
+        while (offset + sizeof(signature) <= size)
+        {
+            const void* found = memchr(data + offset, static_cast<char>(signature & 0xFF), size - offset - sizeof(signature) + 1);
+            if (!found)
+            {
+                break;
+            }
+
+            offset = static_cast<const char*>(found) - data;
+            if (!memcmp(data + offset, &signature, sizeof(signature)))
+            {
+                return offset;
+            }
+            ++offset;
+        }
+        return size;
+    }
+
+private:
+    static uint32_t _Checksum(const BeanFrameHeader& header, const char* payload) noexcept
+    {
+        uint32_t crc = BeanCrc32c::Update(0, &header.length, sizeof(header.length));
+        crc = BeanCrc32c::Update(crc, &header.sequence, sizeof(header.sequence));
+        return BeanCrc32c::Update(crc, payload, header.length);
+    }
+};
@@ -0,0 +1,225 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanIndex keeps a sparse sidecar index of a log file, mapping time and message count to file offsets.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BeanBloom.hpp"
+
+/* Opens the index file, all fields are little-endian. */
+struct BeanIndexHeader
+{
+    static constexpr uint32_t Signature = 0x58444942; // "BIDX"
+
+    uint32_t signature;
+    uint32_t entrySize;
+};
+
+/* Describes the log up to `offset`, an entry is added every time the log grows by the index interval. */
+struct BeanIndexEntry
+{
+    // The latest timestamp written before `offset`, nanoseconds since the UTC epoch. It never goes down
+    // even where the log is slightly out of order, which is what makes the index searchable
+    int64_t time;
+
+    // Messages written before `offset`
+    uint64_t sequence;
+
+    // Where the block written after this entry starts
+    uint64_t offset;
+};
+
+static_assert(sizeof(BeanIndexEntry) == 24);
+
+class BeanIndex
+{
+public:
+    /*
+        How much older than the latest timestamp written a message can still be. Warnings and failures are written
+        ahead of older messages, which follow once they're out of the merge window and no longer held back by a
+        message in flight, see `BeanLog::_Drain`.
+    */
+    static constexpr std::chrono::nanoseconds Reordering = std::chrono::milliseconds(5 + 1000);
+
+    /* Offset from which every message at or after `time` is found, entries are sorted by time. */
+    static uint64_t Seek(std::span<const BeanIndexEntry> entries, int64_t time) noexcept
+    {
+        const auto it = std::partition_point(entries.begin(), entries.end(), [&](const BeanIndexEntry& entry) { return entry.time < time; });
+        return it == entries.begin() ? 0 : std::prev(it)->offset;
+    }
+
+    /*
+        Offset past which only messages at or after `time` are expected, `size` if the index doesn't reach that far.
+        Entries only know the latest timestamp, the search goes on until it's `Reordering` past `time`.
+    */
+    static uint64_t SeekEnd(std::span<const BeanIndexEntry> entries, int64_t time, uint64_t size) noexcept
+    {
+        const int64_t padding = Reordering.count();
+        const int64_t end = time > INT64_MAX - padding ? INT64_MAX : time + padding;
+        const auto it = std::partition_point(entries.begin(), entries.end(), [&](const BeanIndexEntry& entry) { return entry.time < end; });
+        return it == entries.end() ? size : it->offset;
+    }
+};
+
+class BeanIndexSink
+{
+public:
+    using SysTime = std::chrono::sys_time<std::chrono::nanoseconds>;
+
+    /*
+        Writes `<log>.idx`, and `<log>.bloom` with a filter of the words in each segment between two entries
+        if `isFiltered`. `offset` is the log file's current size, a log that's appended to is only indexed from there on.
+    */
+    BeanIndexSink(const std::wstring& log, uint64_t offset, uint64_t interval, bool isFiltered) : _offset(offset), _next(offset), _interval(interval), _segment(offset)
+    {
+        _file = CreateFileW((log + L".idx").c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE)
+        {
+            MessageBoxW(nullptr, L"Failed to create the index file.", L"BeanIndexSink::BeanIndexSink", MB_ICONERROR | MB_OK);
+            return;
+        }
+
+        const BeanIndexHeader header{BeanIndexHeader::Signature, sizeof(BeanIndexEntry)};
+        DWORD written = 0;
+        WriteFile(_file, &header, sizeof(header), &written, nullptr);
+
+        if (!isFiltered)
+        {
+            return;
+        }
+
+        _filterFile = CreateFileW((log + L".bloom").c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_filterFile == INVALID_HANDLE_VALUE)
+        {
+            MessageBoxW(nullptr, L"Failed to create the filter file.", L"BeanIndexSink::BeanIndexSink", MB_ICONERROR | MB_OK);
+            return;
+        }
+
+        // About a byte for every 16 of log, a few percent of false positives for ordinary text
+        const size_t bytes = static_cast<size_t>(std::clamp<uint64_t>(interval / 16, 256, 64 * 1024));
+        const BeanBloomHeader filterHeader{BeanBloomHeader::Signature, static_cast<uint32_t>(bytes), BeanBloom::Hashes, 0};
+        WriteFile(_filterFile, &filterHeader, sizeof(filterHeader), &written, nullptr);
+        _filter = std::make_unique<BeanBloom>(bytes);
+    }
+
+    ~BeanIndexSink()
+    {
+        if (_filter && _offset > _segment)
+        {
+            _WriteFilter();
+        }
+        if (_filterFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(_filterFile);
+        }
+        if (IsOpen())
+        {
+            CloseHandle(_file);
+        }
+    }
+
+    bool IsOpen(void) const noexcept
+    {
+        return _file != INVALID_HANDLE_VALUE;
+    }
+
+    void SetInterval(uint64_t interval) noexcept
+    {
+        _next = (std::min)(_next, _offset + interval);
+        _interval = interval;
+    }
+
+    /* Counts a message about to be written, `text` being everything it's written as. It's only accounted for once its block is. */
+    void Count(SysTime time, std::wstring_view text)
+    {
+        _pendingTime = (std::max)(_pendingTime, time.time_since_epoch().count());
+        ++_pendingSequence;
+
+        if (_filter)
+        {
+            BeanBloom::ForEachWord(text, [this](uint64_t hash) { _words.push_back(hash); });
+        }
+    }
+
+    /* Called right before a block of `bytes` is written to the log, adds an entry if one is due and closes the segment before it. */
+    void Advance(uint64_t bytes)
+    {
+        if (_offset >= _next)
+        {
+            if (_filter && _offset > _segment)
+            {
+                _WriteFilter();
+            }
+
+            const BeanIndexEntry entry{_time, _sequence, _offset};
+            DWORD written = 0;
+            WriteFile(_file, &entry, sizeof(entry), &written, nullptr);
+            _next = _offset + _interval;
+        }
+
+        if (_filter)
+        {
+            for (const uint64_t hash : _words)
+            {
+                _filter->Add(hash);
+            }
+            _words.clear();
+        }
+
+        _offset += bytes;
+        _time = _pendingTime;
+        _sequence = _pendingSequence;
+    }
+
+    BeanIndexSink(const BeanIndexSink&) = delete;
+    BeanIndexSink(BeanIndexSink&&) = delete;
+    BeanIndexSink& operator=(const BeanIndexSink&) = delete;
+    BeanIndexSink& operator=(BeanIndexSink&&) = delete;
+
+private:
+    /* Segments are only written once they're closed, a crash leaves the last one to be searched the slow way. */
+    void _WriteFilter(void)
+    {
+        const BeanBloomSegment segment{_segment, _offset};
+        DWORD written = 0;
+        WriteFile(_filterFile, &segment, sizeof(segment), &written, nullptr);
+        WriteFile(_filterFile, _filter->GetBits().data(), static_cast<DWORD>(_filter->GetBits().size()), &written, nullptr);
+
+        _filter->Clear();
+        _segment = _offset;
+    }
+
+private:
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    uint64_t _offset;
+    uint64_t _next;
+    uint64_t _interval;
+
+    // What the written blocks add up to, and what the one being formatted will add
+    int64_t _time = INT64_MIN;
+    uint64_t _sequence = 0;
+    int64_t _pendingTime = INT64_MIN;
+    uint64_t _pendingSequence = 0;
+
+    // Words of the open segment, those of the block being formatted are added once it's written
+    HANDLE _filterFile = INVALID_HANDLE_VALUE;
+    std::unique_ptr<BeanBloom> _filter;
+    std::vector<uint64_t> _words;
+    uint64_t _segment;
+};
@@ -0,0 +1,194 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanJson encodes messages and their fields as JSON without allocating.
+ */
+
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#if defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "BeanField.hpp"
+
+/* What BeanLog writes to stdout, `json` writes one object per line (JSON Lines). */
+enum class BeanOutputFormat
+{
+    text,
+    json
+};
+
+/* Everything is appended to a caller-owned buffer, once it's grown large enough nothing allocates. */
+class BeanJson
+{
+public:
+    /* Appends `text` as the contents of a JSON string, without the quotes. */
+    static void AppendEscaped(std::wstring& out, std::wstring_view text)
+    {
+        size_t begin = 0;
+        while (begin < text.size())
+        {
+            const size_t end = _FindEscape(text, begin);
+            out.append(text.data() + begin, end - begin);
+            if (end == text.size())
+            {
+                break;
+            }
+
+            _AppendEscape(out, text[end]);
+            begin = end + 1;
+        }
+    }
+
+    /* Keys are literals, they're expected to be ASCII. */
+    static void AppendKey(std::wstring& out, const char* key)
+    {
+        out += L'"';
+        for (; *key; ++key)
+        {
+            if (_NeedsEscape(static_cast<unsigned char>(*key)))
+            {
+                _AppendEscape(out, static_cast<unsigned char>(*key));
+            }
+            else
+            {
+                out += static_cast<unsigned char>(*key);
+            }
+        }
+        out += L"\":";
+    }
+
+    /* Non-finite numbers have no JSON representation, they're written as `null`. */
+    static void AppendValue(std::wstring& out, const BeanValue& value)
+    {
+        switch (value.type)
+        {
+            case BeanValueType::boolean:
+            {
+                out += value.boolean ? L"true" : L"false";
+                break;
+            }
+            case BeanValueType::int64:
+            {
+                std::format_to(std::back_inserter(out), L"{}", value.int64);
+                break;
+            }
+            case BeanValueType::uint64:
+            {
+                std::format_to(std::back_inserter(out), L"{}", value.uint64);
+                break;
+            }
+            case BeanValueType::float64:
+            {
+                if (std::isfinite(value.float64))
+                {
+                    std::format_to(std::back_inserter(out), L"{}", value.float64);
+                }
+                else
+                {
+                    out += L"null";
+                }
+                break;
+            }
+            case BeanValueType::string:
+            {
+                out += L'"';
+                AppendEscaped(out, value.string);
+                out += L'"';
+                break;
+            }
+        }
+    }
+
+private:
+    static bool _NeedsEscape(wchar_t c) noexcept
+    {
+        return c == L'"' || c == L'\\' || static_cast<uint32_t>(c) < 0x20;
+    }
+
+    /* Index of the first character from `from` on that needs escaping, `text.size()` if there's none. */
+    static size_t _FindEscape(std::wstring_view text, size_t from) noexcept
+    {
+        size_t i = from;
+
+#if defined(_M_X64)
+        // Eight UTF-16 units at a time, anything at or below 0x1F saturates to zero when 0x1F is subtracted
+        if constexpr (sizeof(wchar_t) == 2)
+        {
+            const __m128i quote = _mm_set1_epi16(L'"');
+            const __m128i backslash = _mm_set1_epi16(L'\\');
+            const __m128i control = _mm_set1_epi16(0x1F);
+
+            for (; i + 8 <= text.size(); i += 8)
+            {
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+                const __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chars, quote), _mm_cmpeq_epi16(chars, backslash)),
+                                                     _mm_cmpeq_epi16(_mm_subs_epu16(chars, control), _mm_setzero_si128()));
+
+                const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+                if (mask)
+                {
+                    return i + std::countr_zero(mask) / 2;
+                }
+            }
+        }
+#endif
+
+        for (; i < text.size(); ++i)
+        {
+            if (_NeedsEscape(text[i]))
+            {
+                return i;
+            }
+        }
+        return text.size();
+    }
+
+    static void _AppendEscape(std::wstring& out, wchar_t c)
+    {
+        switch (c)
+        {
+            case L'"':
+            {
+                out += L"\\\"";
+                break;
+            }
+            case L'\\':
+            {
+                out += L"\\\\";
+                break;
+            }
+            case L'\n':
+            {
+                out += L"\\n";
+                break;
+            }
+            case L'\r':
+            {
+                out += L"\\r";
+                break;
+            }
+            case L'\t':
+            {
+                out += L"\\t";
+                break;
+            }
+            default:
+            {
+                std::format_to(std::back_inserter(out), L"\\u{:04x}", static_cast<uint32_t>(c));
+                break;
+            }
+        }
+    }
+};
@@ -0,0 +1,48 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanLazy defers an expensive message argument until the message is formatted.
+ */
+
+#pragma once
+
+#include <format>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "BeanField.hpp"
+
+/* A callable that's only invoked once the message it belongs to is formatted, see `bean_lazy`. */
+template <typename FN>
+struct BeanLazy
+{
+    FN fn;
+};
+
+/* Message arguments that can be called without arguments are wrapped, everything else is left as it is. */
+template <typename T>
+decltype(auto) BeanLazyArg(T&& arg)
+{
+    using Type = std::remove_cvref_t<T>;
+    if constexpr (std::is_class_v<Type> && std::is_invocable_v<const Type&> && !std::is_same_v<Type, BeanField>)
+    {
+        return BeanLazy<Type>{std::forward<T>(arg)};
+    }
+    else
+    {
+        return std::forward<T>(arg);
+    }
+}
+
+/* Formats whatever the callable returns, format specs apply to the result. */
+template <typename FN>
+struct std::formatter<BeanLazy<FN>, wchar_t> : std::formatter<std::remove_cvref_t<std::invoke_result_t<const FN&>>, wchar_t>
+{
+    auto format(const BeanLazy<FN>& lazy, std::wformat_context& ctx) const
+    {
+        return std::formatter<std::remove_cvref_t<std::invoke_result_t<const FN&>>, wchar_t>::format(std::invoke(lazy.fn), ctx);
+    }
+};
@@ -0,0 +1,157 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanLine writes messages out as log lines, plain or JSON, for BeanLog and beanlog-collect alike.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <chrono>
+#include <format>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "BeanField.hpp"
+#include "BeanJson.hpp"
+#include "BeanRecord.hpp"
+
+/* Everything is appended to a caller-owned buffer, times are converted by the caller. */
+class BeanLine
+{
+public:
+    using SysTime = std::chrono::sys_time<std::chrono::nanoseconds>;
+    using LocalTime = std::chrono::local_time<std::chrono::system_clock::duration>;
+
+    /* One object per line, timestamps are UTC. */
+    static void AppendJson(std::wstring& out, SysTime time, BeanLogLevel lvl, std::wstring_view category, DWORD syserr, std::wstring_view message,
+                           std::span<const BeanField> contextFields, std::span<const BeanField> fields)
+    {
+        std::format_to(std::back_inserter(out), L"{{\"time\":\"{:%FT%TZ}\",\"level\":\"{}\",\"category\":\"", time, _GetStyle(lvl).tag);
+        BeanJson::AppendEscaped(out, category);
+        out += L"\",\"message\":\"";
+        BeanJson::AppendEscaped(out, message);
+        out += L'"';
+
+        if (syserr)
+        {
+            std::format_to(std::back_inserter(out), L",\"syserr\":{},\"error\":\"", syserr);
+            BeanJson::AppendEscaped(out, GetSystemError(syserr));
+            out += L'"';
+        }
+
+        for (const std::span<const BeanField> span : {contextFields, fields})
+        {
+            for (const BeanField& field : span)
+            {
+                out += L',';
+                BeanJson::AppendKey(out, field.key);
+                BeanJson::AppendValue(out, field.value);
+            }
+        }
+        out += L"}\n";
+    }
+
+    /*
+        `[APP] [time] [LEVEL] [category]: message key=value`, followed by a `[SYS]` line for system errors.
+        Uncategorized messages leave `category` empty, colored lines name their level with colors instead.
+    */
+    static void AppendPlain(std::wstring& out, bool isColored, LocalTime time, BeanLogLevel lvl, std::wstring_view category, DWORD syserr, std::wstring_view message,
+                            std::span<const BeanField> contextFields, std::span<const BeanField> fields)
+    {
+        const _Style& style = _GetStyle(lvl);
+
+        _AppendPrefix(out, isColored, L"APP", style, time, category);
+        out += message;
+        _AppendFields(out, contextFields);
+        _AppendFields(out, fields);
+        out += isColored ? L"\x1B[0m\n" : L"\n";
+
+        if (syserr)
+        {
+            _AppendPrefix(out, isColored, L"SYS", style, time, {});
+            out += GetSystemError(syserr);
+            out += isColored ? L"\x1B[0m\n" : L"\n";
+        }
+    }
+
+    static std::wstring GetSystemError(DWORD syserr)
+    {
+        const std::string error = std::error_code(syserr, std::system_category()).message();
+
+        std::wstring message(MultiByteToWideChar(CP_ACP, 0, error.data(), static_cast<int>(error.size()), nullptr, 0), L'\0');
+        MultiByteToWideChar(CP_ACP, 0, error.data(), static_cast<int>(error.size()), message.data(), static_cast<int>(message.size()));
+        return message;
+    }
+
+private:
+    struct _Style
+    {
+        std::wstring_view prefix;
+        std::wstring_view message;
+        std::wstring_view tag;
+    };
+
+    static const _Style& _GetStyle(BeanLogLevel lvl) noexcept
+    {
+        return _styles[lvl >= BeanLogLevel::trace && lvl < BeanLogLevel::max ? lvl : BeanLogLevel::trace];
+    }
+
+    /* Plain output has no colors to tell levels apart, it names them instead. */
+    static void _AppendPrefix(std::wstring& out, bool isColored, std::wstring_view source, const _Style& style, LocalTime time, std::wstring_view category)
+    {
+        if (isColored)
+        {
+            std::format_to(std::back_inserter(out), L"{}[{}] [{}]", style.prefix, source, time);
+        }
+        else
+        {
+            std::format_to(std::back_inserter(out), L"[{}] [{}] [{}]", source, time, style.tag);
+        }
+
+        if (!category.empty())
+        {
+            std::format_to(std::back_inserter(out), L" [{}]", category);
+        }
+
+        out += L':';
+        if (isColored)
+        {
+            out += style.message;
+        }
+        else
+        {
+            out += L' ';
+        }
+    }
+
+    /* Fields follow the message as `key=value`, values are written the way JSON would. */
+    static void _AppendFields(std::wstring& out, std::span<const BeanField> fields)
+    {
+        for (const BeanField& field : fields)
+        {
+            out += L' ';
+            for (const char* key = field.key; *key; ++key)
+            {
+                out += static_cast<unsigned char>(*key);
+            }
+            out += L'=';
+            BeanJson::AppendValue(out, field.value);
+        }
+    }
+
+private:
+    // Prefix background and message foreground of colored lines, the level's name for the others and for JSON
+    static constexpr _Style _styles[BeanLogLevel::max] = {
+        {L"\x1B[30;107m", L"\x1B[0;97m ", L"TRACE"},
+        {L"\x1B[30;102m", L"\x1B[0;92m ", L"INFO"},
+        {L"\x1B[30;103m", L"\x1B[0;93m ", L"WARN"},
+        {L"\x1B[30;101m", L"\x1B[0;91m ", L"FAIL"},
+    };
+};
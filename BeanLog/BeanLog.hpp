@@ -18,19 +18,43 @@
 
 #include <Windows.h>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <format>
-#include <iostream>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-enum BeanLogLevel
-{
-    trace,
-    info,
-    warn,
-    fail,
-    max
-};
+#include "BeanCapture.hpp"
+#include "BeanCategory.hpp"
+#include "BeanClock.hpp"
+#include "BeanContext.hpp"
+#include "BeanField.hpp"
+#include "BeanFrame.hpp"
+#include "BeanIndex.hpp"
+#include "BeanJson.hpp"
+#include "BeanLazy.hpp"
+#include "BeanLine.hpp"
+#include "BeanProfile.hpp"
+#include "BeanRecord.hpp"
+#include "BeanRequest.hpp"
+#include "BeanShared.hpp"
+#include "BeanSite.hpp"
+#include "BeanThread.hpp"
+#include "BeanTrace.hpp"
+#include "BeanWorkers.hpp"
 
 class BeanLog
 {
@@ -41,82 +65,683 @@ public:
         return Logger;
     }
 
+    /* Sets the level of uncategorized messages and of every category without a level of its own. */
     void SetLogLevel(BeanLogLevel lvl)
     {
+        BeanCategory::SetInheritedLevel(lvl);
+    }
+
+    /* Runtime lookup by name, for settings and consoles, see `bean_set_categorylevelbyname`. `bean_set_categorylevel` skips it. */
+    bool SetCategoryLevel(std::wstring_view name, BeanLogLevel lvl)
+    {
+        BeanCategory* category = BeanCategory::Find(name);
+        if (!category)
+        {
+            return false;
+        }
+
+        category->SetLevel(lvl);
+        return true;
+    }
+
+    /*
+        Switches every call site matching the patterns on, off, or back to following its level.
+        Sites that run for the first time later on are matched too. Returns how many matched so far.
+    */
+    size_t SetSiteState(std::wstring_view filePattern, std::wstring_view functionPattern, BeanSiteState state)
+    {
+        return BeanSites::SetState(filePattern, functionPattern, state);
+    }
+
+    /* Logs the `count` call sites that ran the most and the ones that spent the most time formatting, see `bean_report_sites`. */
+    void ReportSites(size_t count)
+    {
+        std::vector<BeanSiteStats> sites = BeanSites::GetStats();
+
+        double nsPerTick = 1.0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            nsPerTick = _clock.NanosecondsPerTick();
+        }
+
+        count = (std::min)(count, sites.size());
+        std::partial_sort(sites.begin(), sites.begin() + count, sites.end(), [](const BeanSiteStats& a, const BeanSiteStats& b)
+        {
+            return a.calls > b.calls;
+        });
+        for (size_t i = 0; i < count && sites[i].calls; ++i)
+        {
+            _ReportSite(L"calls", i + 1, sites[i], nsPerTick);
+        }
+
+        std::partial_sort(sites.begin(), sites.begin() + count, sites.end(), [](const BeanSiteStats& a, const BeanSiteStats& b)
+        {
+            return a.formatTicks > b.formatTicks;
+        });
+        for (size_t i = 0; i < count && sites[i].formatTicks; ++i)
+        {
+            _ReportSite(L"cost", i + 1, sites[i], nsPerTick);
+        }
+    }
+
+    /*
+        How many sites `~BeanLog` reports, zero (the default) skips the report. Sites only count their calls
+        while it's set, counting makes even disabled calls write to their site.
+    */
+    void SetSiteReport(size_t count)
+    {
+        _siteReport.store(count, std::memory_order_relaxed);
+        BeanSites::SetCounting(count > 0);
+    }
+
+    /* Request scopes need to see filtered messages too, a disabled site also reads the thread's current request. */
+    static bool IsEnabled(BeanLogSite& site) noexcept
+    {
+        return site.Check() || (BeanRequestScope::GetCurrent() && site.GetState() != BeanSiteState::off);
+    }
+
+    /* Selects where timestamps come from, see `BeanClockSource`. */
+    void SetClockSource(BeanClockSource src)
+    {
+        // Measuring the TSC spins for a while, nobody waits on it while it's done here
+        const BeanClock::Source source = BeanClock::Measure(src);
+
+        // Queued records and spans carry ticks of the current source
+        _Drain(true);
+
         std::lock_guard<std::mutex> lock(_mutex);
-        _logLevel = lvl;
+        _clock.SetSource(source);
+
+        // Ticks of the new source don't compare with the old ones
+        BeanThreadRegistry::Get().ForEach([](BeanThreadState& state)
+        {
+            state.mergeTicks = 0;
+        });
     }
 
-    template <typename... ARGS>
-    void Log(BeanLogLevel lvl, DWORD syserr, const wchar_t* fmt, ARGS... args)
+    /*
+        Async mode queues formatted messages on the calling thread and leaves the writing to the
+        backend, each thread's messages keep their order. Turning it off writes out what's queued.
+    */
+    void SetAsync(bool async)
+    {
+        _async.store(async, std::memory_order_relaxed);
+        if (async)
+        {
+            _StartBackend();
+        }
+        else
+        {
+            _Drain(true);
+        }
+    }
+
+    bool IsAsync(void) const noexcept
+    {
+        return _async.load(std::memory_order_relaxed);
+    }
+
+    /*
+        Failures don't return before they're on disk. In async mode they're committed in groups: the
+        backend writes every failure queued so far and flushes the output file's buffers once for all of
+        them, see `SetCommitLatency`. Otherwise each one is flushed on its own.
+    */
+    void SetDurable(bool durable)
+    {
+        _durable.store(durable, std::memory_order_relaxed);
+    }
+
+    /* How long the backend lets a group of durable failures gather before committing it, trading latency for throughput. */
+    void SetCommitLatency(std::chrono::microseconds latency)
+    {
+        _commitLatency.store(latency, std::memory_order_relaxed);
+    }
+
+    /*
+        Writes warnings and failures on the calling thread even in async mode, then flushes the
+        output file's buffers to disk. Otherwise they're queued apart and written ahead of the backlog.
+    */
+    void SetPrioritySync(bool sync)
+    {
+        _prioritySync.store(sync, std::memory_order_relaxed);
+    }
+
+    /*
+        Starts `count` threads that help the backend format deferred records, zero stops them. Large
+        batches are split among them and the backend, then written out in the order they were queued.
+    */
+    void SetFormatWorkers(size_t count)
+    {
+        std::unique_ptr<BeanWorkers> workers = count ? std::make_unique<BeanWorkers>(count) : nullptr;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _workers.swap(workers);
+    }
+
+    /* Async messages too large for any of `BeanSlab`'s size classes, they were allocated from the heap. */
+    uint64_t GetHeapRecords(void)
     {
         std::lock_guard<std::mutex> lock(_mutex);
+        return _heapRecords;
+    }
+
+    /* Selects how messages and their `kv` fields are written, see `BeanOutputFormat`. */
+    void SetOutputFormat(BeanOutputFormat format)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _outputFormat = format;
+    }
+
+    /*
+        Wraps everything written to a file in frames that carry a length, a sequence number and a CRC32C,
+        so that `beanlog-recover` can tell where a crash cut the output short. Consoles are left alone.
+    */
+    void SetFraming(bool framed)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isFramed = framed;
+    }
 
-        // Make sure to filter messages based on severity
-        if (lvl < _logLevel)
+    /*
+        Keeps a sparse index of the log file in `<log file>.idx`, adding an entry every `bytes` of output,
+        zero turns it off. `beanlog-seek` uses it to jump to a time window without reading the whole log.
+    */
+    void SetIndexInterval(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _indexInterval = bytes;
+        if (!bytes)
         {
-            SetLastError(0);
-            return;
+            _indexSink.reset();
+        }
+        else if (_indexSink)
+        {
+            _indexSink->SetInterval(bytes);
+        }
+    }
+
+    /*
+        Adds a Bloom filter of the words written to each segment of the index, in `<log file>.bloom`,
+        `beanlog-grep` skips the segments that can't hold what it looks for. Takes effect when the index is opened.
+    */
+    void SetSegmentFilters(bool filtered)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isFiltered = filtered;
+    }
+
+    /*
+        Hands every message over to the ring in shared memory named `name` instead of writing it, `beanlog-collect`
+        formats and writes them from its own process. The ring gets `bytes`, `nullptr` goes back to writing here.
+    */
+    void SetSharedRing(const wchar_t* name, size_t bytes)
+    {
+        // Whatever is still queued belongs to the previous output
+        _Drain(true);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _sharedSink.reset();
+        if (name)
+        {
+            _sharedSink = std::make_unique<BeanSharedSink>(name, bytes);
+            if (!_sharedSink->IsOpen())
+            {
+                _sharedSink.reset();
+            }
+        }
+    }
+
+    /* Starts writing `bean_scope` spans to `path` as trace-event JSON, `nullptr` stops tracing. */
+    void SetTraceFile(const wchar_t* path)
+    {
+        _tracing.store(false, std::memory_order_relaxed);
+
+        // Whatever is still queued belongs to the previous file
+        _Drain();
+
+        uint64_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _traceSink.reset();
+            dropped = std::exchange(_droppedSpans, 0);
+
+            if (path)
+            {
+                _traceSink = std::make_unique<BeanTraceSink>(path);
+                if (!_traceSink->IsOpen())
+                {
+                    _traceSink.reset();
+                }
+            }
+        }
+
+        if (dropped)
+        {
+            Log(BeanLogLevel::warn, 0, L"[BeanLog] {} spans were dropped, the backend couldn't keep up.", dropped);
+        }
+
+        if (_traceSink)
+        {
+            _StartBackend();
+            _tracing.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    bool IsTracing(void) const noexcept
+    {
+        return _tracing.load(std::memory_order_relaxed);
+    }
+
+    /* Aggregates `bean_scope` spans and reports their statistics every `interval`, zero turns it off. */
+    void SetProfileInterval(std::chrono::milliseconds interval)
+    {
+        const bool wasProfiling = _profiling.exchange(interval.count() > 0, std::memory_order_relaxed);
+        _profileInterval.store(interval, std::memory_order_relaxed);
+
+        if (interval.count() > 0)
+        {
+            _StartBackend();
+        }
+        else if (wasProfiling)
+        {
+            _ReportProfile(true);
+        }
+    }
+
+    bool IsProfiling(void) const noexcept
+    {
+        return _profiling.load(std::memory_order_relaxed);
+    }
+
+    /* Selects which half of the per-thread statistics tables producers write to. */
+    uint32_t GetProfileEpoch(void) const noexcept
+    {
+        return _profileEpoch.load(std::memory_order_relaxed);
+    }
+
+    /* Raw ticks from the current clock source, see `BeanClock::Now`. */
+    uint64_t Now(void) const noexcept
+    {
+        return _clock.Now();
+    }
+
+    template <typename... ARGS>
+    void Log(BeanLogLevel lvl, DWORD syserr, const wchar_t* fmt, ARGS&&... args)
+    {
+        const BeanCategory& category = BeanCategory::Default();
+        _Log(category, lvl, category.IsEnabled(lvl), nullptr, syserr, fmt, BeanLazyArg(std::forward<ARGS>(args))...);
+    }
+
+    template <typename... ARGS>
+    void Log(const BeanCategory& category, BeanLogLevel lvl, DWORD syserr, const wchar_t* fmt, ARGS&&... args)
+    {
+        _Log(category, lvl, category.IsEnabled(lvl), nullptr, syserr, fmt, BeanLazyArg(std::forward<ARGS>(args))...);
+    }
+
+    /*
+        What the `bean_*` macros call, the site has already been checked by then and none of the arguments
+        are evaluated unless it's enabled. Callables are only invoked once the message is formatted.
+        In async mode, `fmt` is kept as it is until then, the macros only accept literals.
+    */
+    template <typename... ARGS>
+    void Log(BeanLogSite& site, DWORD syserr, const wchar_t* fmt, ARGS&&... args)
+    {
+        _Log(site.GetCategory(), site.GetLevel(), site.IsEnabled(), &site, syserr, fmt, BeanLazyArg(std::forward<ARGS>(args))...);
+    }
+
+private:
+    /*
+        Marks the thread as holding a timestamp it hasn't queued yet, a thread preempted on its way to the queue would
+        otherwise have its message overtaken by newer ones. Nested messages are covered by the outermost one.
+    */
+    struct _InFlight
+    {
+        _InFlight(BeanThreadState* state, uint64_t ticks) noexcept
+            : state(state && state->inFlight.load(std::memory_order_relaxed) == UINT64_MAX ? state : nullptr)
+        {
+            if (this->state)
+            {
+                this->state->inFlight.store(ticks, std::memory_order_relaxed);
+            }
         }
 
-        // Select the correct color for the output
-        switch (lvl)
+        // Released once the message is queued, the backend seeing it cleared sees the message too
+        ~_InFlight()
         {
-            default:
-            case BeanLogLevel::trace:
+            if (state)
             {
-                _color1 = L"\x1B[30;107m";
-                _color2 = L"\x1B[0;97m ";
-                break;
+                state->inFlight.store(UINT64_MAX, std::memory_order_release);
             }
-            case BeanLogLevel::info:
+        }
+
+        BeanThreadState* state;
+    };
+
+    template <typename... ARGS>
+    void _Log(const BeanCategory& category, BeanLogLevel lvl, bool enabled, BeanLogSite* site, DWORD syserr, const wchar_t* fmt, ARGS&&... args)
+    {
+        // Set before the message's own ticks are taken, it's a bound on them however long the store takes to show
+        const _InFlight inFlight(_async.load(std::memory_order_relaxed) && !BeanThreadState::exiting ? &BeanThreadState::Current() : nullptr, _clock.Now());
+
+        // Only raw ticks are taken here, the conversion to wall-clock time happens at output
+        const uint64_t ticks = _clock.Now();
+
+        // The context is only looked up once the message is written, all it takes here is its top
+        BeanContext* context = BeanContextScope::GetCurrent();
+        const uint64_t top = context ? context->GetTop() : 0;
+
+        // Inside a request, anything below `warn` waits to see whether the request fails
+        BeanRequestScope* request = BeanRequestScope::GetCurrent();
+        if (request && !request->failed && lvl < BeanLogLevel::warn)
+        {
+            // The context will have moved on by the time the request fails, if it does
+            BeanContext::Snapshot snapshot;
+            if (top)
             {
-                _color1 = L"\x1B[30;102m";
-                _color2 = L"\x1B[0;92m ";
-                break;
+                context->Collect(top, snapshot);
             }
-            case BeanLogLevel::warn:
+
+            BeanRecord record{&category, lvl, syserr, ticks, _Format(site, ticks, fmt, args...)};
+            record.SetFields(snapshot.GetFields(), _GetFields(args...));
+            request->Buffer(std::move(record));
+            SetLastError(0);
+            return;
+        }
+
+        // Make sure to filter messages based on severity, failed requests are logged in full
+        if (!request && !enabled)
+        {
+            SetLastError(0);
+            return;
+        }
+
+        const auto fields = _GetFields(args...);
+
+        // Warnings and failures take the priority lane, or skip the queue altogether with `SetPrioritySync`
+        const bool urgent = lvl >= BeanLogLevel::warn;
+        const bool durable = lvl == BeanLogLevel::fail && _durable.load(std::memory_order_relaxed);
+        const bool async = !request && !BeanThreadState::exiting && _async.load(std::memory_order_relaxed) && !(urgent && _prioritySync.load(std::memory_order_relaxed));
+
+        // Messages from a site whose arguments can all be captured are left for the backend to format
+        if constexpr ((BeanIsCapturable<ARGS>() && ...))
+        {
+            if (site && async)
             {
-                _color1 = L"\x1B[30;103m";
-                _color2 = L"\x1B[0;93m ";
-                break;
+                const std::tuple<BeanCaptured<ARGS>...> captured{BeanCapture(args)...};
+                const bool queued = _Enqueue(urgent, BeanPackedRecord::GetDeferredSize(fields, captured), [&](void* block)
+                {
+                    return BeanPackedRecord::PackDeferred(block, category, lvl, syserr, ticks, fields, top, site, fmt, captured);
+                });
+
+                if (queued)
+                {
+                    if (durable)
+                    {
+                        _AwaitCommit();
+                    }
+                    if (syserr)
+                    {
+                        SetLastError(0);
+                    }
+                    return;
+                }
             }
-            case BeanLogLevel::fail:
+        }
+
+        std::wstring message = _Format(site, ticks, fmt, args...);
+
+        const bool queued = async && _Enqueue(urgent, BeanPackedRecord::GetSize(message, fields), [&](void* block)
+        {
+            return BeanPackedRecord::Pack(block, category, lvl, syserr, ticks, message, fields, top);
+        });
+
+        if (queued)
+        {
+            _Recycle(std::move(message));
+            if (durable)
+            {
+                _AwaitCommit();
+            }
+            if (syserr)
             {
-                _color1 = L"\x1B[30;101m";
-                _color2 = L"\x1B[0;91m ";
-                break;
+                SetLastError(0);
             }
+            return;
+        }
+
+        // Anything this thread queued has to come out before what the request held back
+        if (request && !request->failed && _async.load(std::memory_order_relaxed))
+        {
+            _Drain(true);
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        // The request failed, write out what it held back before the message that made it fail
+        if (request && !request->failed)
+        {
+            request->failed = true;
+            _WriteRequest(*request);
+        }
+
+        _Write(category, lvl, ticks, syserr, message, fields, context, top);
+        _Flush();
+
+        if (((urgent && _prioritySync.load(std::memory_order_relaxed)) || durable) && _IsOnDisk())
+        {
+            FlushFileBuffers(_outHandle);
         }
 
-        // Format application message
-        std::wcout << _color1
-                   << std::format(L"[APP] [{}]:", _GetTime())
-                   << _color2
-                   << std::vformat(fmt, std::make_wformat_args(std::forward<ARGS>(args)...))
-                   << L"\x1B[0m" << std::endl;
+        lock.unlock();
+        _Recycle(std::move(message));
 
-        // Format system error
         if (syserr)
         {
-            std::wcout << _color1
-                       << std::format(L"[SYS] [{}]:", _GetTime())
-                       << _color2
-                       << std::error_code(syserr, std::system_category()).message().c_str()
-                       << L"\x1B[0m" << std::endl;
             SetLastError(0);
         }
     }
 
-private:
-    std::chrono::local_time<std::chrono::system_clock::duration> _GetTime(void)
+    /* Messages coming from a site have their size and formatting time added to its counters. */
+    template <typename... ARGS>
+    std::wstring _Format(BeanLogSite* site, uint64_t ticks, const wchar_t* fmt, ARGS&... args)
     {
-        return std::chrono::zoned_time{std::chrono::current_zone(), std::chrono::system_clock::now()}.get_local_time();
+        // Reuses the thread's scratch buffer, a message logged while formatting this one just gets a fresh string
+        std::wstring message = BeanThreadState::exiting ? std::wstring() : std::move(_scratch.buffer);
+        message.clear();
+        std::vformat_to(std::back_inserter(message), fmt, std::make_wformat_args(args...));
+        if (site)
+        {
+            site->CountMessage(message.size() * sizeof(wchar_t), _clock.Now() - ticks);
+        }
+        return message;
     }
 
-protected:
-    /* Allocates a console, opens stdout and enables colored output. */
-    BeanLog()
+    /* Picks the `kv` arguments out of a message's arguments, in order. */
+    template <typename... ARGS>
+    static auto _GetFields(const ARGS&... args) noexcept
+    {
+        // Named fields arrive as references, `const` or not
+        std::array<BeanField, (0 + ... + std::is_same_v<std::remove_cvref_t<ARGS>, BeanField>)> fields;
+
+        [[maybe_unused]] size_t i = 0;
+        ([&]
+        {
+            if constexpr (std::is_same_v<std::remove_cvref_t<ARGS>, BeanField>)
+            {
+                fields[i++] = args;
+            }
+        }(), ...);
+        return fields;
+    }
+
+    /* Hands the buffer back once the message is written, so that the next one doesn't allocate. */
+    static void _Recycle(std::wstring&& message) noexcept
+    {
+        if (!BeanThreadState::exiting)
+        {
+            _scratch.buffer = std::move(message);
+        }
+    }
+
+    /* Copies the message into a block of the thread's slab, fails only if that can't be allocated. Urgent ones wake the backend up. */
+    template <typename FN>
+    bool _Enqueue(bool urgent, size_t bytes, FN&& pack)
+    {
+        BeanThreadState& state = BeanThreadState::Current();
+
+        void* block = state.slab.Allocate(bytes);
+        if (!block)
+        {
+            return false;
+        }
+
+        BeanPackedRecord* record = pack(block);
+
+        // The backend is behind, catch up from here rather than reorder this thread's messages. What's left may be
+        // waiting on a thread that's still to queue an older one, it needs the processor more than this one does
+        while (!(urgent ? state.urgent.TryPush(record) : state.records.TryPush(record)))
+        {
+            _Drain(false, false);
+            std::this_thread::yield();
+        }
+
+        if (urgent)
+        {
+            _wake.notify_one();
+        }
+        return true;
+    }
+
+    /* The context, if any, is written before the message's own fields. */
+    void _Write(const BeanCategory& category, BeanLogLevel lvl, uint64_t ticks, DWORD syserr, std::wstring_view message, std::span<const BeanField> fields = {}, const BeanContext* context = nullptr, uint64_t top = 0)
+    {
+        std::span<const BeanField> contextFields;
+        if (top)
+        {
+            context->Collect(top, _contextSnapshot);
+            contextFields = _contextSnapshot.GetFields();
+        }
+
+        // The collector does the formatting, all that's left here is a copy
+        if (_sharedSink)
+        {
+            _sharedSink->Write(category.GetName(), lvl, _clock.ToSysTime(ticks).time_since_epoch().count(), syserr, message, contextFields, fields);
+            return;
+        }
+
+        // Applications that never write anything never get a console
+        std::call_once(_consoleOnce, &BeanLog::_OpenConsole, this);
+
+        if (_indexInterval && !_indexSink)
+        {
+            _OpenIndex();
+        }
+
+        const size_t begin = _output.size();
+        if (_outputFormat == BeanOutputFormat::json)
+        {
+            BeanLine::AppendJson(_output, _clock.ToSysTime(ticks), lvl, category.GetName(), syserr, message, contextFields, fields);
+        }
+        else
+        {
+            // Uncategorized messages look just like they always did
+            const std::wstring_view name = &category == &BeanCategory::Default() ? std::wstring_view() : category.GetName();
+            BeanLine::AppendPlain(_output, _isColored, _clock.ToLocalTime(ticks), lvl, name, syserr, message, contextFields, fields);
+        }
+
+        if (_indexSink)
+        {
+            _indexSink->Count(_clock.ToSysTime(ticks), std::wstring_view(_output).substr(begin));
+        }
+    }
+
+    /* Consoles have nothing to flush to disk, and neither does the shared ring. Needs `_mutex` to be held. */
+    bool _IsOnDisk(void) const noexcept
+    {
+        return !_isConsole && !_sharedSink;
+    }
+
+    /*
+        Writes every line `_Write` gathered with a single call, the console gets them as they are while
+        redirected output is converted to UTF-8. Needs `_mutex` to be held, like `_Write` does.
+    */
+    void _Flush(void)
+    {
+        if (_output.empty())
+        {
+            return;
+        }
+
+        DWORD written = 0;
+        if (_isConsole)
+        {
+            WriteConsoleW(_outHandle, _output.data(), static_cast<DWORD>(_output.size()), &written, nullptr);
+        }
+        else
+        {
+            _outputUtf8.resize(WideCharToMultiByte(CP_UTF8, 0, _output.data(), static_cast<int>(_output.size()), nullptr, 0, nullptr, nullptr));
+            WideCharToMultiByte(CP_UTF8, 0, _output.data(), static_cast<int>(_output.size()), _outputUtf8.data(), static_cast<int>(_outputUtf8.size()), nullptr, nullptr);
+            std::string_view block = _outputUtf8;
+            if (_isFramed)
+            {
+                _frame.clear();
+                BeanFrame::Append(_frame, _frameSequence++, _outputUtf8);
+                block = _frame;
+            }
+
+            if (_indexSink)
+            {
+                _indexSink->Advance(block.size());
+            }
+            WriteFile(_outHandle, block.data(), static_cast<DWORD>(block.size()), &written, nullptr);
+        }
+
+        _output.clear();
+    }
+
+    /* The index lives next to the log file, it's opened along with the first message written once indexing is on. */
+    void _OpenIndex(void)
+    {
+        // Consoles and pipes have no path, and nothing to seek in
+        const DWORD length = _isConsole ? 0 : GetFinalPathNameByHandleW(_outHandle, nullptr, 0, FILE_NAME_NORMALIZED);
+        std::wstring path(length, L'\0');
+        if (!length || GetFinalPathNameByHandleW(_outHandle, path.data(), length, FILE_NAME_NORMALIZED) != length - 1)
+        {
+            _indexInterval = 0;
+            return;
+        }
+        path.resize(length - 1);
+
+        LARGE_INTEGER size{};
+        GetFileSizeEx(_outHandle, &size);
+        _indexSink = std::make_unique<BeanIndexSink>(path, static_cast<uint64_t>(size.QuadPart), _indexInterval, _isFiltered);
+        if (!_indexSink->IsOpen())
+        {
+            _indexSink.reset();
+            _indexInterval = 0;
+        }
+    }
+
+    /* Messages keep the time they were logged at, not the time the request failed. */
+    void _WriteRequest(BeanRequestScope& request)
+    {
+        if (request.dropped)
+        {
+            const uint64_t ticks = request.records.empty() ? _clock.Now() : request.records.front().ticks;
+            _Write(BeanCategory::Default(), BeanLogLevel::info, ticks, 0, std::format(L"[BeanLog] {} earlier messages of this request were dropped.", request.dropped));
+        }
+
+        for (const BeanRecord& record : request.records)
+        {
+            _Write(*record.category, record.level, record.ticks, record.syserr, record.message, record.fields);
+        }
+
+        request.records.clear();
+        request.dropped = 0;
+    }
+
+    /* Allocates a console, opens stdout and enables colored output, see `_Write`. */
+    void _OpenConsole(void)
     {
         // Check if there's a console already attached to the current process
         if ((_outHandle = GetStdHandle(STD_OUTPUT_HANDLE)) == nullptr)
@@ -124,14 +749,14 @@ protected:
             _isConsoleAllocated = AllocConsole();
             if (!_isConsoleAllocated)
             {
-                MessageBoxW(nullptr, L"Failed to allocate a console.", L"BeanLog::BeanLog", MB_ICONERROR | MB_OK);
+                MessageBoxW(nullptr, L"Failed to allocate a console.", L"BeanLog::_OpenConsole", MB_ICONERROR | MB_OK);
                 return;
             }
 
             freopen_s(&_fConOut, "CONOUT$", "w", stdout);
             if (!_fConOut)
             {
-                MessageBoxW(nullptr, L"Failed to reopen STDOUT.", L"BeanLog::BeanLog", MB_ICONERROR | MB_OK);
+                MessageBoxW(nullptr, L"Failed to reopen STDOUT.", L"BeanLog::_OpenConsole", MB_ICONERROR | MB_OK);
                 return;
             }
             else
@@ -142,29 +767,486 @@ protected:
             _outHandle = GetStdHandle(STD_OUTPUT_HANDLE);
             if (_outHandle == INVALID_HANDLE_VALUE)
             {
-                MessageBoxW(nullptr, L"Failed to get STD_OUTPUT_HANDLE.\nOutput won't be colored.", L"BeanLog::BeanLog", MB_ICONWARNING | MB_OK);
+                MessageBoxW(nullptr, L"Failed to get STD_OUTPUT_HANDLE.\nOutput won't be colored.", L"BeanLog::_OpenConsole", MB_ICONWARNING | MB_OK);
                 return;
             }
         }
 
+        // Redirected to a file or a pipe, escape sequences would only get in the way
         if (!GetConsoleMode(_outHandle, &_mode))
         {
-            MessageBoxW(nullptr, L"Failed to get the console mode.\nOutput won't be colored.", L"BeanLog::BeanLog", MB_ICONWARNING | MB_OK);
+            return;
+        }
+        _isConsole = true;
+
+        // See <https://no-color.org>, any value but an empty one turns colors off
+        if (GetEnvironmentVariableW(L"NO_COLOR", nullptr, 0) > 1)
+        {
             return;
         }
 
         if (!SetConsoleMode(_outHandle, _mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING))
         {
-            MessageBoxW(nullptr, L"Failed to set the console mode.\nOutput won't be colored.", L"BeanLog::BeanLog", MB_ICONWARNING | MB_OK);
+            MessageBoxW(nullptr, L"Failed to set the console mode.\nOutput won't be colored.", L"BeanLog::_OpenConsole", MB_ICONWARNING | MB_OK);
+            return;
+        }
+        _isColored = true;
+    }
+
+    void _StartBackend(void)
+    {
+        std::call_once(_backendOnce, [this] { _backend = std::thread(&BeanLog::_BackendMain, this); });
+    }
+
+    /* Blocks until the backend has written the failure the calling thread just queued and flushed it to disk. */
+    void _AwaitCommit(void)
+    {
+        std::unique_lock<std::mutex> lock(_commitMutex);
+
+        // Rounds collect after they begin, the one after the current round is the first sure to include the record
+        const uint64_t round = _commitRound + 1;
+        if (_commitPending < round)
+        {
+            _commitPending = round;
+            _commitSince = std::chrono::steady_clock::now();
+        }
+        _committed.wait(lock, [&] { return _commitDone >= round; });
+    }
+
+    /* Returns the round the next drain commits, zero if no one is waiting for one. */
+    uint64_t _BeginCommit(void)
+    {
+        std::unique_lock<std::mutex> lock(_commitMutex);
+        if (_commitPending <= _commitRound)
+        {
+            return 0;
+        }
+
+        // Give the failures logged meanwhile a chance to join the group
+        const auto deadline = _commitSince + _commitLatency.load(std::memory_order_relaxed);
+        lock.unlock();
+        std::this_thread::sleep_until(deadline);
+        lock.lock();
+
+        return ++_commitRound;
+    }
+
+    /* One flush covers every failure written since the round began. */
+    void _EndCommit(uint64_t round)
+    {
+        if (!round)
+        {
+            return;
+        }
+
+        bool isOnDisk;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            isOnDisk = _IsOnDisk();
+        }
+        if (isOnDisk)
+        {
+            FlushFileBuffers(_outHandle);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_commitMutex);
+            _commitDone = round;
+        }
+        _committed.notify_all();
+    }
+
+    /* The backend wakes up every `_drainPeriod` and moves what producers recorded into the sinks. */
+    void _BackendMain(void)
+    {
+        std::chrono::steady_clock::time_point nextReport{};
+
+        std::unique_lock<std::mutex> lock(_backendMutex);
+        while (!_stopping)
+        {
+            _wake.wait_for(lock, _drainPeriod);
+
+            lock.unlock();
+            const uint64_t round = _BeginCommit();
+            _Drain();
+            _EndCommit(round);
+
+            const auto interval = _profileInterval.load(std::memory_order_relaxed);
+            const auto now = std::chrono::steady_clock::now();
+            if (interval.count() <= 0)
+            {
+                nextReport = {};
+            }
+            else if (nextReport == std::chrono::steady_clock::time_point{})
+            {
+                nextReport = now + interval;
+            }
+            else if (now >= nextReport)
+            {
+                _ReportProfile(false);
+                nextReport = now + interval;
+            }
+            lock.lock();
+        }
+    }
+
+    /* Appends a deferred record's message to `out`, safe to call from the workers. */
+    void _FormatDeferred(const BeanPackedRecord& record, std::wstring& out) const
+    {
+        const uint64_t begin = _clock.Now();
+        const size_t offset = out.size();
+
+        try
+        {
+            record.Format(out);
+        }
+        catch (const std::format_error&)
+        {
+            // There's no caller left to throw to, the format string is better than nothing
+            out.resize(offset);
+            out += record.format;
+        }
+
+        if (record.site)
+        {
+            record.site->CountMessage((out.size() - offset) * sizeof(wchar_t), _clock.Now() - begin);
+        }
+    }
+
+    /* Warnings and failures skip the merge window and the backlog, they go out before anything else is formatted. */
+    void _WriteUrgent(void)
+    {
+        if (_urgent.empty())
+        {
             return;
         }
+
+        std::stable_sort(_urgent.begin(), _urgent.end(), [](const _Pending& a, const _Pending& b)
+        {
+            return a.key < b.key;
+        });
+
+        for (const _Pending& pending : _urgent)
+        {
+            const BeanPackedRecord& packed = *pending.record;
+            _deferred.clear();
+            if (packed.IsDeferred())
+            {
+                _FormatDeferred(packed, _deferred);
+            }
+
+            _Write(*packed.category, packed.level, packed.ticks, packed.syserr, packed.IsDeferred() ? std::wstring_view(_deferred) : packed.GetText(), packed.GetFields(), &pending.state->context, packed.context);
+            BeanSlab::Release(pending.record, pending.state->released);
+        }
+        _urgent.clear();
+        _Flush();
+    }
+
+    /*
+        Merges the records `_Drain` collected into a single order by timestamp and writes them out, formatting them
+        in parallel if there's enough of them. Unless `all` is set, records less than `_mergeWindow` old are held
+        back until the next drain, another thread may still be about to queue something older. So are records
+        newer than a message that's still in flight, for up to `_inFlightLimit`.
+    */
+    void _WritePending(bool all)
+    {
+        std::stable_sort(_pending.begin(), _pending.end(), [](const _Pending& a, const _Pending& b)
+        {
+            return a.key < b.key;
+        });
+
+        // Exited threads wait their turn like the others, their states are kept until their last record is written
+        size_t count = _pending.size();
+        if (!all)
+        {
+            const auto toTicks = [this](std::chrono::milliseconds duration)
+            {
+                return static_cast<uint64_t>(std::chrono::duration<double, std::nano>(duration).count() / _clock.NanosecondsPerTick());
+            };
+
+            // A message in flight for longer than `_inFlightLimit` is most likely stuck in a callable, with everything
+            // newer piling up behind it. It may land out of order, but it doesn't hold the output up any longer
+            const uint64_t now = _drainTicks;
+            uint64_t horizon = now - toTicks(_mergeWindow);
+            if (_inFlight != UINT64_MAX && static_cast<int64_t>(_inFlight - horizon) < 0)
+            {
+                const uint64_t oldest = now - toTicks(_inFlightLimit);
+                horizon = static_cast<int64_t>(_inFlight - oldest) > 0 ? _inFlight : oldest;
+            }
+
+            count = std::partition_point(_pending.begin(), _pending.end(), [horizon](const _Pending& pending)
+            {
+                return static_cast<int64_t>(pending.key - horizon) <= 0;
+            }) - _pending.begin();
+        }
+
+        const size_t parts = _workers && count >= _parallelThreshold ? _workers->GetCount() : 1;
+        if (_formatted.size() < parts)
+        {
+            _formatted.resize(parts);
+        }
+
+        // Each part formats a contiguous run of records into a buffer of its own
+        const auto format = [this, count, parts](size_t part)
+        {
+            std::wstring& out = _formatted[part];
+            out.clear();
+            for (size_t i = count * part / parts; i < count * (part + 1) / parts; ++i)
+            {
+                _Pending& pending = _pending[i];
+                if (pending.record->IsDeferred())
+                {
+                    pending.part = part;
+                    pending.offset = out.size();
+                    _FormatDeferred(*pending.record, out);
+                    pending.length = out.size() - pending.offset;
+                }
+            }
+        };
+
+        if (parts > 1)
+        {
+            _workers->Run(format);
+        }
+        else
+        {
+            format(0);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const _Pending& pending = _pending[i];
+            const BeanPackedRecord& packed = *pending.record;
+            const std::wstring_view message = packed.IsDeferred() ? std::wstring_view(_formatted[pending.part]).substr(pending.offset, pending.length) : packed.GetText();
+            _Write(*packed.category, packed.level, packed.ticks, packed.syserr, message, packed.GetFields(), &pending.state->context, packed.context);
+            BeanSlab::Release(pending.record, pending.state->released);
+            --pending.state->unwritten;
+        }
+        _pending.erase(_pending.begin(), _pending.begin() + count);
+
+        // Blocks go back to their thread's slab in one go
+        for (BeanThreadState* state : _visited)
+        {
+            state->slab.Return(state->released);
+        }
+        _visited.clear();
+    }
+
+    /*
+        Writes out what every thread queued, see `_WritePending` for what `all` means. Unless `wait` is set,
+        a thread that's already at it does just as well and the call returns straight away.
+    */
+    void _Drain(bool all = false, bool wait = true)
+    {
+        std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+        if (wait)
+        {
+            lock.lock();
+        }
+        else if (!lock.try_lock())
+        {
+            return;
+        }
+
+        // The horizon is measured from here, the drain may well be preempted before it's done visiting threads
+        _drainTicks = _clock.Now();
+        _inFlight = UINT64_MAX;
+        BeanThreadRegistry::Get().ForEach([this](BeanThreadState& state)
+        {
+            // Read ahead of the queue, a message that's no longer in flight is in there by now
+            _inFlight = (std::min)(_inFlight, state.inFlight.load(std::memory_order_acquire));
+
+            state.spans.Drain([&](const BeanSpan& span)
+            {
+                if (_traceSink)
+                {
+                    _traceSink->Write(span, state.tid, _clock.ToSysTime(span.begin), _clock.ToDuration(span.end - span.begin));
+                }
+            });
+
+            _droppedSpans += state.droppedSpans.exchange(0, std::memory_order_relaxed);
+
+            // Records are only collected here, they're written once every thread has been visited. Ticks and the horizon
+            // never go backwards, keys are clamped all the same in case two cores' TSCs disagree, merging keeps each thread's order
+            state.records.Drain([&](BeanPackedRecord* record)
+            {
+                state.mergeTicks = (std::max)(state.mergeTicks, record->ticks);
+                _pending.push_back({record, &state, state.mergeTicks});
+                ++state.unwritten;
+            });
+            _visited.push_back(&state);
+            state.urgent.Drain([&](BeanPackedRecord* record)
+            {
+                _urgent.push_back({record, &state, record->ticks});
+            });
+            _heapRecords += state.slab.TakeHeapFallbacks();
+
+            // The state is freed once its records are written, keep its statistics around until the next report
+            if (state.retired.load(std::memory_order_acquire))
+            {
+                _profileCarry.resize(BeanScopeSite::Count());
+                state.profile[0].MoveInto(_profileCarry);
+                state.profile[1].MoveInto(_profileCarry);
+            }
+        }, [this, all]
+        {
+            _WriteUrgent();
+            _WritePending(all);
+        });
+
+        // Whatever the threads queued goes out in one go
+        _Flush();
+
+        if (_traceSink)
+        {
+            _traceSink->Flush();
+        }
+    }
+
+    /*
+        Reports what the other half of the statistics tables collected, then flips producers over to it. A producer
+        that read the epoch just before a flip may still be writing to the half it left, so halves are only read one
+        whole interval after they were retired. `final` also takes the half that's just been retired, once
+        `_profileGrace` has passed.
+    */
+    void _ReportProfile(bool final)
+    {
+        std::lock_guard<std::mutex> reportLock(_profileMutex);
+
+        std::vector<BeanScopeSummary> summaries(BeanScopeSite::Count());
+        const auto collect = [&](uint32_t half)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            BeanThreadRegistry::Get().ForEach([&](BeanThreadState& state)
+            {
+                // Threads that exited have no writes in flight, both halves can go
+                state.profile[half].MoveInto(summaries);
+                if (state.retired.load(std::memory_order_acquire))
+                {
+                    state.profile[half ^ 1].MoveInto(summaries);
+                }
+            });
+        };
+
+        // Producers move over to the half that's read here, and the one they leave gets a whole interval to settle
+        const uint32_t current = _profileEpoch.load(std::memory_order_relaxed) & 1;
+        collect(current ^ 1);
+        _profileEpoch.fetch_add(1, std::memory_order_relaxed);
+        if (final)
+        {
+            std::this_thread::sleep_for(_profileGrace);
+            collect(current);
+        }
+
+        double nsPerTick = 1.0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t i = 0; i < _profileCarry.size() && i < summaries.size(); ++i)
+            {
+                summaries[i].Merge(_profileCarry[i]);
+            }
+            _profileCarry.clear();
+
+            nsPerTick = _clock.NanosecondsPerTick();
+        }
+
+        BeanScopeSite::ForEach([&](std::wstring_view name, std::wstring_view file, int line, uint32_t id)
+        {
+            // Sites registered after `summaries` was sized have nothing to report yet
+            if (id >= summaries.size() || !summaries[id].count)
+            {
+                return;
+            }
+
+            const BeanScopeSummary& summary = summaries[id];
+
+            Log(BeanLogLevel::info, 0, L"[PROF] {} ({}:{}) calls={} total={} avg={} min={} max={} p50<={} p99<={}",
+                name, file.substr(file.find_last_of(L"\\/") + 1), line, summary.count,
+                _FormatDuration(summary.total * nsPerTick),
+                _FormatDuration(static_cast<double>(summary.total) / summary.count * nsPerTick),
+                _FormatDuration(summary.min * nsPerTick),
+                _FormatDuration(summary.max * nsPerTick),
+                _FormatDuration(summary.Quantile(0.50) * nsPerTick),
+                _FormatDuration(summary.Quantile(0.99) * nsPerTick));
+        });
+    }
+
+    void _ReportSite(const wchar_t* ranking, size_t rank, const BeanSiteStats& site, double nsPerTick)
+    {
+        const std::wstring_view file = site.file;
+
+        Log(BeanLogLevel::info, 0, L"[SITE] {} #{} {}:{} {} calls={} emitted={} bytes={} format={} avg={}",
+            ranking, rank, file.substr(file.find_last_of(L"\\/") + 1), site.line, site.function,
+            site.calls, site.emitted, site.bytes,
+            _FormatDuration(site.formatTicks * nsPerTick),
+            _FormatDuration(site.emitted ? site.formatTicks * nsPerTick / site.emitted : 0.0));
+    }
+
+    static std::wstring _FormatDuration(double ns)
+    {
+        if (ns < 1e3)
+        {
+            return std::format(L"{:.0f}ns", ns);
+        }
+        if (ns < 1e6)
+        {
+            return std::format(L"{:.2f}us", ns / 1e3);
+        }
+        if (ns < 1e9)
+        {
+            return std::format(L"{:.2f}ms", ns / 1e6);
+        }
+        return std::format(L"{:.2f}s", ns / 1e9);
+    }
+
+protected:
+    /* Nothing is opened up front, the console is only set up once there's something to write. */
+    BeanLog()
+    {
+        // Producers' states and the default category must outlive the backend, so they have to be constructed first
+        BeanThreadRegistry::Get();
+        BeanCategory::Default();
+
+        // The first local timestamp would otherwise wait for the time zone database to load
+        _preload = std::thread(&BeanClock::Preload);
     }
 
     /* Deallocates the console and closes stdout. */
     ~BeanLog()
     {
+        _preload.join();
+
+        // Stop the backend and write out whatever it didn't get to
+        if (_backend.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(_backendMutex);
+                _stopping = true;
+            }
+            _wake.notify_one();
+            _backend.join();
+        }
+        SetAsync(false);
+        SetFormatWorkers(0);
+
+        // The backend is gone and everything queued has been written, release anyone still waiting on a commit
+        {
+            std::lock_guard<std::mutex> lock(_commitMutex);
+            _commitDone = UINT64_MAX;
+        }
+        _committed.notify_all();
+        SetProfileInterval(std::chrono::milliseconds::zero());
+        SetTraceFile(nullptr);
+        if (const size_t count = _siteReport.load(std::memory_order_relaxed))
+        {
+            ReportSites(count);
+        }
+
         // Restore the changes made in order to display colors, useful if the current process is a console application
-        SetConsoleMode(_outHandle, _mode);
+        if (_isColored)
+        {
+            SetConsoleMode(_outHandle, _mode);
+        }
 
         // Only close stdout if BeanLog opened it
         if (_isStdoutOpen)
@@ -192,24 +1274,216 @@ public:
     BeanLog& operator=(BeanLog&&) = delete;
 
 private:
-    int _logLevel = BeanLogLevel::trace;
+    std::once_flag _consoleOnce;
+    std::thread _preload;
     bool _isConsoleAllocated = false;
     bool _isStdoutOpen = false;
     FILE* _fConOut = nullptr;
     HANDLE _outHandle = INVALID_HANDLE_VALUE;
+    bool _isConsole = false;
+    std::wstring _output;
+    std::string _outputUtf8;
+    bool _isFramed = false;
+    uint64_t _frameSequence = 0;
+    std::string _frame;
+    size_t _indexInterval = 0;
+    bool _isFiltered = false;
+    std::unique_ptr<BeanIndexSink> _indexSink;
+    std::unique_ptr<BeanSharedSink> _sharedSink;
     std::mutex _mutex;
-    const wchar_t* _color1 = nullptr;
-    const wchar_t* _color2 = nullptr;
+    BeanClock _clock;
+    std::atomic<bool> _tracing = false;
+    std::unique_ptr<BeanTraceSink> _traceSink;
+    uint64_t _droppedSpans = 0;
+    std::atomic<bool> _profiling = false;
+    std::atomic<uint32_t> _profileEpoch = 0;
+    std::atomic<std::chrono::milliseconds> _profileInterval{};
+    std::mutex _profileMutex;
+    std::vector<BeanScopeSummary> _profileCarry;
+    std::atomic<size_t> _siteReport = 0;
+    std::atomic<bool> _async = false;
+    std::atomic<bool> _prioritySync = false;
+    std::atomic<bool> _durable = false;
+    std::atomic<std::chrono::microseconds> _commitLatency{std::chrono::microseconds(1000)};
+    uint64_t _heapRecords = 0;
+
+    // Thread-locals are destroyed before statics, messages logged from static destructors must not touch them. Threads
+    // that only ever defer formatting never touch the scratch buffer, their state's owner raises the flag instead
+    struct _Scratch
+    {
+        ~_Scratch()
+        {
+            BeanThreadState::exiting = true;
+        }
+
+        std::wstring buffer;
+    };
+    static inline thread_local _Scratch _scratch;
+    std::once_flag _backendOnce;
+    std::thread _backend;
+    std::mutex _backendMutex;
+    std::condition_variable _wake;
+    bool _stopping = false;
+    static constexpr std::chrono::milliseconds _drainPeriod{2};
+    static constexpr std::chrono::milliseconds _mergeWindow{5};
+    static constexpr std::chrono::milliseconds _inFlightLimit{1000};
+    static_assert(_mergeWindow + _inFlightLimit <= BeanIndex::Reordering, "BeanIndex::SeekEnd would stop short of late messages.");
+    static constexpr std::chrono::milliseconds _profileGrace{10};
+
+    // Group commit, producers wait for `_commitDone` to reach the round after the one in progress
+    std::mutex _commitMutex;
+    std::condition_variable _committed;
+    uint64_t _commitRound = 0;
+    uint64_t _commitPending = 0;
+    uint64_t _commitDone = 0;
+    std::chrono::steady_clock::time_point _commitSince{};
+    bool _isColored = false;
+    BeanOutputFormat _outputFormat = BeanOutputFormat::text;
+    BeanContext::Snapshot _contextSnapshot;
+
+    // Records collected by `_Drain`, some may wait there for the next one
+    struct _Pending
+    {
+        BeanPackedRecord* record;
+        BeanThreadState* state;
+        uint64_t key;
+        size_t part = 0;
+        size_t offset = 0;
+        size_t length = 0;
+    };
+    std::vector<_Pending> _pending;
+    std::vector<_Pending> _urgent;
+    std::vector<BeanThreadState*> _visited;
+    uint64_t _inFlight = UINT64_MAX;
+    uint64_t _drainTicks = 0;
+    std::wstring _deferred;
+    std::vector<std::wstring> _formatted;
+    std::unique_ptr<BeanWorkers> _workers;
+    static constexpr size_t _parallelThreshold = 64;
     DWORD _mode{};
 };
 
+/* Records the lifetime of the enclosing scope as a span and/or into its site's statistics, see `bean_scope`. */
+class BeanScope
+{
+public:
+    explicit BeanScope(const BeanScopeSite& site) noexcept
+        : _site(site)
+    {
+        BeanLog& logger = BeanLog::GetInstance();
+        _trace = logger.IsTracing();
+        _profile = logger.IsProfiling();
+        if ((!_trace && !_profile) || BeanThreadState::exiting)
+        {
+            return;
+        }
+
+        _state = &BeanThreadState::Current();
+        _depth = _state->depth++;
+        _begin = logger.Now();
+    }
+
+    ~BeanScope()
+    {
+        if (!_state)
+        {
+            return;
+        }
+
+        BeanLog& logger = BeanLog::GetInstance();
+        const uint64_t end = logger.Now();
+        --_state->depth;
+
+        // Never stall a frame because the backend is behind, just keep count
+        if (_trace && !_state->spans.TryPush({_site.name, _begin, end, _depth}))
+        {
+            _state->droppedSpans.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (_profile)
+        {
+            _state->profile[logger.GetProfileEpoch() & 1].Record(_site.id, end - _begin);
+        }
+    }
+
+    BeanScope(const BeanScope&) = delete;
+    BeanScope(BeanScope&&) = delete;
+    BeanScope& operator=(const BeanScope&) = delete;
+    BeanScope& operator=(BeanScope&&) = delete;
+
+private:
+    const BeanScopeSite& _site;
+    BeanThreadState* _state = nullptr;
+    uint64_t _begin = 0;
+    uint32_t _depth = 0;
+    bool _trace = false;
+    bool _profile = false;
+};
+
 /* Maximizing ease of use as Singletons aren't exactly 'pretty'. */
 
+#define BEANLOG_CONCAT_IMPL(A, B) A##B
+#define BEANLOG_CONCAT(A, B) BEANLOG_CONCAT_IMPL(A, B)
+#define BEANLOG_CATEGORY(NAME) BEANLOG_CONCAT(beanCategory_, NAME)
+
+/*
+    Every expansion registers a static site the first time it runs. A disabled site then costs the static's guard
+    check, the load of its flags and that of the thread's current request, plus a counter bump while calls are
+    counted; its arguments are never evaluated. Like a filtered message always did, it clears the
+    thread's last error so that it doesn't get reported by an unrelated message later on. Sites and deferred
+    records keep the format string without copying it, `L""` only lets literals through.
+*/
+#define BEANLOG_LOG(CATEGORY, LOG_LEVEL, FORMAT_STRING, ...)                                                                       \
+    do                                                                                                                             \
+    {                                                                                                                              \
+        static BeanLogSite _beanSite(CATEGORY, BeanLogLevel::LOG_LEVEL, L"" __FILE__, __LINE__, __FUNCTIONW__, L"" FORMAT_STRING); \
+        if (BeanLog::IsEnabled(_beanSite))                                                                                         \
+        {                                                                                                                          \
+            BeanLog::GetInstance().Log(_beanSite, GetLastError(), L"" FORMAT_STRING, __VA_ARGS__);                                 \
+        }                                                                                                                          \
+        else                                                                                                                       \
+        {                                                                                                                          \
+            SetLastError(0);                                                                                                       \
+        }                                                                                                                          \
+    } while (0)
+
 #define bean_set_loglevel(LOG_LEVEL) BeanLog::GetInstance().SetLogLevel(LOG_LEVEL)
-#define bean_trace(FORMAT_STRING, ...) BeanLog::GetInstance().Log(BeanLogLevel::trace, GetLastError(), FORMAT_STRING, __VA_ARGS__)
-#define bean_info(FORMAT_STRING, ...) BeanLog::GetInstance().Log(BeanLogLevel::info, GetLastError(), FORMAT_STRING, __VA_ARGS__)
-#define bean_warn(FORMAT_STRING, ...) BeanLog::GetInstance().Log(BeanLogLevel::warn, GetLastError(), FORMAT_STRING, __VA_ARGS__)
-#define bean_fail(FORMAT_STRING, ...) BeanLog::GetInstance().Log(BeanLogLevel::fail, GetLastError(), FORMAT_STRING, __VA_ARGS__)
+#define bean_set_clocksource(CLOCK_SOURCE) BeanLog::GetInstance().SetClockSource(BeanClockSource::CLOCK_SOURCE)
+#define bean_set_tracefile(PATH) BeanLog::GetInstance().SetTraceFile(PATH)
+#define bean_set_profileinterval(MILLISECONDS) BeanLog::GetInstance().SetProfileInterval(std::chrono::milliseconds(MILLISECONDS))
+#define bean_set_sitestate(FILE_PATTERN, FUNCTION_PATTERN, SITE_STATE) BeanLog::GetInstance().SetSiteState(FILE_PATTERN, FUNCTION_PATTERN, BeanSiteState::SITE_STATE)
+#define bean_set_sitereport(COUNT) BeanLog::GetInstance().SetSiteReport(COUNT)
+#define bean_report_sites(COUNT) BeanLog::GetInstance().ReportSites(COUNT)
+#define bean_set_async(ASYNC) BeanLog::GetInstance().SetAsync(ASYNC)
+#define bean_set_outputformat(OUTPUT_FORMAT) BeanLog::GetInstance().SetOutputFormat(BeanOutputFormat::OUTPUT_FORMAT)
+#define bean_set_framing(FRAMED) BeanLog::GetInstance().SetFraming(FRAMED)
+#define bean_set_indexinterval(KILOBYTES) BeanLog::GetInstance().SetIndexInterval(static_cast<size_t>(KILOBYTES) * 1024)
+#define bean_set_segmentfilters(FILTERED) BeanLog::GetInstance().SetSegmentFilters(FILTERED)
+#define bean_set_formatworkers(COUNT) BeanLog::GetInstance().SetFormatWorkers(COUNT)
+#define bean_set_prioritysync(SYNC) BeanLog::GetInstance().SetPrioritySync(SYNC)
+#define bean_set_durable(DURABLE) BeanLog::GetInstance().SetDurable(DURABLE)
+#define bean_set_commitlatency(MICROSECONDS) BeanLog::GetInstance().SetCommitLatency(std::chrono::microseconds(MICROSECONDS))
+#define bean_set_sharedring(NAME, KILOBYTES) BeanLog::GetInstance().SetSharedRing(NAME, static_cast<size_t>(KILOBYTES) * 1024)
+#define bean_trace(FORMAT_STRING, ...) BEANLOG_LOG(BeanCategory::Default(), trace, FORMAT_STRING, __VA_ARGS__)
+#define bean_info(FORMAT_STRING, ...) BEANLOG_LOG(BeanCategory::Default(), info, FORMAT_STRING, __VA_ARGS__)
+#define bean_warn(FORMAT_STRING, ...) BEANLOG_LOG(BeanCategory::Default(), warn, FORMAT_STRING, __VA_ARGS__)
+#define bean_fail(FORMAT_STRING, ...) BEANLOG_LOG(BeanCategory::Default(), fail, FORMAT_STRING, __VA_ARGS__)
+#define bean_scope(NAME)                                                                             \
+    static BeanScopeSite BEANLOG_CONCAT(_beanScopeSite, __LINE__)(L"" NAME, L"" __FILE__, __LINE__); \
+    BeanScope BEANLOG_CONCAT(_beanScope, __LINE__)(BEANLOG_CONCAT(_beanScopeSite, __LINE__))
+#define bean_request_scope() BeanRequestScope BEANLOG_CONCAT(_beanRequest, __LINE__)
+#define bean_context(KEY, VALUE) BeanContextScope BEANLOG_CONCAT(_beanContext, __LINE__)(kv(KEY, VALUE))
+#define bean_lazy(EXPRESSION) [&] { return EXPRESSION; }
+
+/* Categories are declared once, at namespace scope, usually in a header shared by the subsystem. */
+
+#define bean_declare_category(NAME) inline BeanCategory BEANLOG_CATEGORY(NAME)(L"" #NAME)
+#define bean_set_categorylevel(NAME, LOG_LEVEL) BEANLOG_CATEGORY(NAME).SetLevel(LOG_LEVEL)
+#define bean_set_categorylevelbyname(NAME, LOG_LEVEL) BeanLog::GetInstance().SetCategoryLevel(NAME, LOG_LEVEL)
+#define bean_ctrace(NAME, FORMAT_STRING, ...) BEANLOG_LOG(BEANLOG_CATEGORY(NAME), trace, FORMAT_STRING, __VA_ARGS__)
+#define bean_cinfo(NAME, FORMAT_STRING, ...) BEANLOG_LOG(BEANLOG_CATEGORY(NAME), info, FORMAT_STRING, __VA_ARGS__)
+#define bean_cwarn(NAME, FORMAT_STRING, ...) BEANLOG_LOG(BEANLOG_CATEGORY(NAME), warn, FORMAT_STRING, __VA_ARGS__)
+#define bean_cfail(NAME, FORMAT_STRING, ...) BEANLOG_LOG(BEANLOG_CATEGORY(NAME), fail, FORMAT_STRING, __VA_ARGS__)
 
 #elif NDEBUG
 
@@ -220,9 +1494,36 @@ private:
 */
 
 #define bean_set_loglevel(LOG_LEVEL)
+#define bean_set_clocksource(CLOCK_SOURCE)
+#define bean_set_tracefile(PATH)
+#define bean_set_profileinterval(MILLISECONDS)
+#define bean_set_sitestate(FILE_PATTERN, FUNCTION_PATTERN, SITE_STATE)
+#define bean_set_sitereport(COUNT)
+#define bean_report_sites(COUNT)
+#define bean_set_async(ASYNC)
+#define bean_set_outputformat(OUTPUT_FORMAT)
+#define bean_set_framing(FRAMED)
+#define bean_set_indexinterval(KILOBYTES)
+#define bean_set_segmentfilters(FILTERED)
+#define bean_set_formatworkers(COUNT)
+#define bean_set_prioritysync(SYNC)
+#define bean_set_durable(DURABLE)
+#define bean_set_commitlatency(MICROSECONDS)
+#define bean_set_sharedring(NAME, KILOBYTES)
 #define bean_trace(FORMAT_STRING, ...)
 #define bean_info(FORMAT_STRING, ...)
 #define bean_warn(FORMAT_STRING, ...)
 #define bean_fail(FORMAT_STRING, ...)
+#define bean_scope(NAME)
+#define bean_request_scope()
+#define bean_context(KEY, VALUE)
+#define bean_lazy(EXPRESSION)
+#define bean_declare_category(NAME)
+#define bean_set_categorylevel(NAME, LOG_LEVEL)
+#define bean_set_categorylevelbyname(NAME, LOG_LEVEL)
+#define bean_ctrace(NAME, FORMAT_STRING, ...)
+#define bean_cinfo(NAME, FORMAT_STRING, ...)
+#define bean_cwarn(NAME, FORMAT_STRING, ...)
+#define bean_cfail(NAME, FORMAT_STRING, ...)
 
 #endif
@@ -0,0 +1,246 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanProfile aggregates `bean_scope` spans into per-thread statistics tables.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Static descriptor of a `bean_scope` call site, every expansion of the macro owns one. */
+struct BeanScopeSite
+{
+    BeanScopeSite(const wchar_t* name, const wchar_t* file, int line)
+        : name(name), file(file), line(line), id(_count.fetch_add(1, std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        next = _head;
+        _head = this;
+    }
+
+    /*
+        Sites of an unloaded module must not be left dangling in the list. They're destroyed along with their module,
+        or at exit, which is usually before the last report; a copy of their names still reports what they collected.
+    */
+    ~BeanScopeSite()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (BeanScopeSite** it = &_head; *it; it = &(*it)->next)
+        {
+            if (*it == this)
+            {
+                *it = next;
+                break;
+            }
+        }
+        _retired.push_back({name, file, line, id});
+    }
+
+    /* Calls `fn(name, file, line, id)` for every site, destroyed ones included. Sites can't come or go until it returns. */
+    template <typename FN>
+    static void ForEach(FN&& fn)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const BeanScopeSite* site = _head; site; site = site->next)
+        {
+            fn(std::wstring_view(site->name), std::wstring_view(site->file), site->line, site->id);
+        }
+
+        for (const _Retired& site : _retired)
+        {
+            fn(std::wstring_view(site.name), std::wstring_view(site.file), site.line, site.id);
+        }
+    }
+
+    static uint32_t Count(void) noexcept
+    {
+        return _count.load(std::memory_order_acquire);
+    }
+
+    const wchar_t* name;
+    const wchar_t* file;
+    int line;
+    uint32_t id;
+    BeanScopeSite* next = nullptr;
+
+public:
+    BeanScopeSite(const BeanScopeSite&) = delete;
+    BeanScopeSite(BeanScopeSite&&) = delete;
+    BeanScopeSite& operator=(const BeanScopeSite&) = delete;
+    BeanScopeSite& operator=(BeanScopeSite&&) = delete;
+
+private:
+    struct _Retired
+    {
+        std::wstring name;
+        std::wstring file;
+        int line;
+        uint32_t id;
+    };
+
+private:
+    static inline std::mutex _mutex;
+    static inline BeanScopeSite* _head = nullptr;
+    static inline std::vector<_Retired> _retired;
+    static inline std::atomic<uint32_t> _count = 0;
+};
+
+/* Totals of one call site, bucket `i` of the histogram counts durations in [2^(i-1), 2^i) ticks. */
+struct BeanScopeSummary
+{
+    static constexpr size_t buckets = 40;
+
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t min = (std::numeric_limits<uint64_t>::max)();
+    uint64_t max = 0;
+    uint64_t histogram[buckets]{};
+
+    void Merge(const BeanScopeSummary& other) noexcept
+    {
+        count += other.count;
+        total += other.total;
+        min = (std::min)(min, other.min);
+        max = (std::max)(max, other.max);
+
+        for (size_t i = 0; i < buckets; ++i)
+        {
+            histogram[i] += other.histogram[i];
+        }
+    }
+
+    /* Upper bound, in ticks, of the bucket the `q`th quantile falls in. */
+    uint64_t Quantile(double q) const noexcept
+    {
+        const auto rank = static_cast<uint64_t>(q * count);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets; ++i)
+        {
+            seen += histogram[i];
+            if (seen > rank)
+            {
+                return (std::min)(uint64_t{1} << i, max);
+            }
+        }
+        return max;
+    }
+};
+
+/* Counters of one call site on one thread, only the owning thread ever stores to them. */
+struct BeanScopeStats
+{
+    // Plain load/store pairs, the owning thread is the only writer so there's no need for locked RMW instructions
+    void Record(uint64_t ticks) noexcept
+    {
+        _Bump(count, 1);
+        _Bump(total, ticks);
+
+        if (ticks < min.load(std::memory_order_relaxed))
+        {
+            min.store(ticks, std::memory_order_relaxed);
+        }
+        if (ticks > max.load(std::memory_order_relaxed))
+        {
+            max.store(ticks, std::memory_order_relaxed);
+        }
+
+        _Bump(histogram[(std::min<size_t>)(std::bit_width(ticks), BeanScopeSummary::buckets - 1)], 1);
+    }
+
+    /* Consumer side, folds the counters into `summary` and starts over. */
+    void MoveInto(BeanScopeSummary& summary) noexcept
+    {
+        summary.count += count.exchange(0, std::memory_order_relaxed);
+        summary.total += total.exchange(0, std::memory_order_relaxed);
+        summary.min = (std::min)(summary.min, min.exchange((std::numeric_limits<uint64_t>::max)(), std::memory_order_relaxed));
+        summary.max = (std::max)(summary.max, max.exchange(0, std::memory_order_relaxed));
+
+        for (size_t i = 0; i < BeanScopeSummary::buckets; ++i)
+        {
+            summary.histogram[i] += histogram[i].exchange(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> total = 0;
+    std::atomic<uint64_t> min = (std::numeric_limits<uint64_t>::max)();
+    std::atomic<uint64_t> max = 0;
+    std::atomic<uint64_t> histogram[BeanScopeSummary::buckets]{};
+
+private:
+    static void _Bump(std::atomic<uint64_t>& counter, uint64_t value) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+};
+
+/* A thread's statistics indexed by site id, blocks are allocated the first time one of their sites runs. */
+class BeanScopeTable
+{
+public:
+    static constexpr uint32_t blockSize = 64;
+    static constexpr uint32_t maxBlocks = 64;
+
+    ~BeanScopeTable()
+    {
+        for (auto& block : _blocks)
+        {
+            delete block.load(std::memory_order_relaxed);
+        }
+    }
+
+    void Record(uint32_t id, uint64_t ticks)
+    {
+        if (id >= blockSize * maxBlocks)
+        {
+            return;
+        }
+
+        std::atomic<_Block*>& slot = _blocks[id / blockSize];
+        _Block* block = slot.load(std::memory_order_relaxed);
+        if (!block)
+        {
+            block = new _Block;
+            slot.store(block, std::memory_order_release);
+        }
+
+        block->stats[id % blockSize].Record(ticks);
+    }
+
+    /* Consumer side, `summaries` is indexed by site id and must be large enough for every site. */
+    void MoveInto(std::vector<BeanScopeSummary>& summaries) noexcept
+    {
+        for (uint32_t b = 0; b < maxBlocks; ++b)
+        {
+            _Block* block = _blocks[b].load(std::memory_order_acquire);
+            if (!block)
+            {
+                continue;
+            }
+
+            for (uint32_t i = 0; i < blockSize && b * blockSize + i < summaries.size(); ++i)
+            {
+                block->stats[i].MoveInto(summaries[b * blockSize + i]);
+            }
+        }
+    }
+
+private:
+    struct _Block
+    {
+        BeanScopeStats stats[blockSize];
+    };
+
+    std::atomic<_Block*> _blocks[maxBlocks]{};
+};
@@ -0,0 +1,171 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanRecord is a log message that hasn't been written yet.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "BeanCapture.hpp"
+#include "BeanField.hpp"
+
+enum BeanLogLevel
+{
+    trace,
+    info,
+    warn,
+    fail,
+    max
+};
+
+class BeanCategory;
+class BeanLogSite;
+
+struct BeanRecord
+{
+    const BeanCategory* category;
+    BeanLogLevel level;
+    DWORD syserr;
+    uint64_t ticks;
+    std::wstring message;
+
+    // String values point into `strings`, which doesn't move along with the record
+    std::vector<BeanField> fields;
+    std::vector<wchar_t> strings;
+
+    /* Copies the context's fields and then `src`, strings would otherwise point into memory the record doesn't own. */
+    void SetFields(std::span<const BeanField> context, std::span<const BeanField> src)
+    {
+        fields.resize(context.size() + src.size());
+        strings.resize(BeanField::StringSize(context) + BeanField::StringSize(src));
+        BeanField::Copy(context, fields.data(), strings.data());
+        BeanField::Copy(src, fields.data() + context.size(), strings.data() + BeanField::StringSize(context));
+    }
+};
+
+/*
+    A record laid out in a single `BeanSlab` block, followed by its fields, the message and the fields' strings.
+    Deferred records carry the captured arguments instead of the message and are formatted by whoever writes them.
+*/
+struct BeanPackedRecord
+{
+    const BeanCategory* category;
+    BeanLogLevel level;
+    DWORD syserr;
+    uint64_t ticks;
+    size_t length;
+    size_t fieldCount;
+    uint64_t context;
+
+    // Deferred records only, `format` comes from the site and lives as long as it does
+    BeanLogSite* site;
+    const wchar_t* format;
+    void (*formatter)(const BeanPackedRecord&, std::wstring&);
+
+    /* Bytes needed to pack a record, see `Pack`. */
+    static size_t GetSize(std::wstring_view message, std::span<const BeanField> fields) noexcept
+    {
+        return sizeof(BeanPackedRecord) + fields.size() * sizeof(BeanField) + (message.size() + BeanField::StringSize(fields)) * sizeof(wchar_t);
+    }
+
+    /* `context` is the top of the producer's `BeanContext`, it's only looked at once the record is written. */
+    static BeanPackedRecord* Pack(void* block, const BeanCategory& category, BeanLogLevel level, DWORD syserr, uint64_t ticks, std::wstring_view message, std::span<const BeanField> fields, uint64_t context) noexcept
+    {
+        BeanPackedRecord* record = new (block) BeanPackedRecord{&category, level, syserr, ticks, message.size(), fields.size(), context, nullptr, nullptr, nullptr};
+
+        BeanField* packedFields = reinterpret_cast<BeanField*>(record + 1);
+        wchar_t* text = reinterpret_cast<wchar_t*>(packedFields + fields.size());
+        BeanField::Copy(fields, packedFields, std::copy(message.begin(), message.end(), text));
+        return record;
+    }
+
+    /* Bytes needed to pack a deferred record, see `PackDeferred`. */
+    template <typename ARGS>
+    static size_t GetDeferredSize(std::span<const BeanField> fields, const ARGS& args) noexcept
+    {
+        return _GetArgsOffset<ARGS>(fields.size()) + sizeof(ARGS) + (BeanField::StringSize(fields) + BeanCaptureSize(args)) * sizeof(wchar_t);
+    }
+
+    /* Packs what `BeanCapture` made of the arguments, their strings are copied here and nowhere else. */
+    template <typename ARGS>
+    static BeanPackedRecord* PackDeferred(void* block, const BeanCategory& category, BeanLogLevel level, DWORD syserr, uint64_t ticks, std::span<const BeanField> fields, uint64_t context, BeanLogSite* site, const wchar_t* format, const ARGS& args) noexcept
+    {
+        static_assert(std::is_trivially_destructible_v<ARGS>, "Records are released without being destroyed.");
+
+        BeanPackedRecord* record = new (block) BeanPackedRecord{&category, level, syserr, ticks, 0, fields.size(), context, site, format, &_FormatDeferred<ARGS>};
+
+        ARGS* packedArgs = new (reinterpret_cast<char*>(record) + _GetArgsOffset<ARGS>(fields.size())) ARGS(args);
+        wchar_t* storage = reinterpret_cast<wchar_t*>(packedArgs + 1);
+        BeanField::Copy(fields, reinterpret_cast<BeanField*>(record + 1), storage);
+        storage += BeanField::StringSize(fields);
+
+        std::apply([&](auto&... arg)
+        {
+            ([&]
+            {
+                if constexpr (std::is_same_v<std::remove_reference_t<decltype(arg)>, std::wstring_view>)
+                {
+                    const wchar_t* copy = storage;
+                    storage = std::copy(arg.begin(), arg.end(), storage);
+                    arg = {copy, arg.size()};
+                }
+            }(), ...);
+        }, *packedArgs);
+        return record;
+    }
+
+    bool IsDeferred(void) const noexcept
+    {
+        return formatter != nullptr;
+    }
+
+    /* Deferred records only, appends the message to `out`. Throws `std::format_error` if the format string is bad. */
+    void Format(std::wstring& out) const
+    {
+        formatter(*this, out);
+    }
+
+    std::span<const BeanField> GetFields(void) const noexcept
+    {
+        return {reinterpret_cast<const BeanField*>(this + 1), fieldCount};
+    }
+
+    std::wstring_view GetText(void) const noexcept
+    {
+        return {reinterpret_cast<const wchar_t*>(GetFields().data() + fieldCount), length};
+    }
+
+private:
+    template <typename ARGS>
+    static constexpr size_t _GetArgsOffset(size_t fieldCount) noexcept
+    {
+        const size_t offset = sizeof(BeanPackedRecord) + fieldCount * sizeof(BeanField);
+        return (offset + alignof(ARGS) - 1) / alignof(ARGS) * alignof(ARGS);
+    }
+
+    template <typename ARGS>
+    static void _FormatDeferred(const BeanPackedRecord& record, std::wstring& out)
+    {
+        const ARGS& args = *reinterpret_cast<const ARGS*>(reinterpret_cast<const char*>(&record) + _GetArgsOffset<ARGS>(record.fieldCount));
+        std::apply([&](const auto&... arg)
+        {
+            std::vformat_to(std::back_inserter(out), record.format, std::make_wformat_args(arg...));
+        }, args);
+    }
+};
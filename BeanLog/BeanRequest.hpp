@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanRequest holds back a thread's low severity messages until its request either fails or ends.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+#include "BeanRecord.hpp"
+
+/*
+    While alive, `trace` and `info` messages of the calling thread are buffered instead of written.
+    A `warn` or `fail` writes them out and lets the rest of the request through, otherwise they're
+    discarded when the scope ends. Nested scopes join the outermost one.
+*/
+class BeanRequestScope
+{
+public:
+    static constexpr size_t capacity = 512;
+
+    BeanRequestScope() noexcept
+    {
+        if (!_current)
+        {
+            _current = this;
+        }
+    }
+
+    ~BeanRequestScope()
+    {
+        if (_current == this)
+        {
+            _current = nullptr;
+        }
+    }
+
+    static BeanRequestScope* GetCurrent(void) noexcept
+    {
+        return _current;
+    }
+
+    /* Only the most recent `capacity` messages are kept. */
+    void Buffer(BeanRecord&& record)
+    {
+        if (records.size() == capacity)
+        {
+            records.pop_front();
+            ++dropped;
+        }
+        records.push_back(std::move(record));
+    }
+
+    BeanRequestScope(const BeanRequestScope&) = delete;
+    BeanRequestScope(BeanRequestScope&&) = delete;
+    BeanRequestScope& operator=(const BeanRequestScope&) = delete;
+    BeanRequestScope& operator=(BeanRequestScope&&) = delete;
+
+public:
+    std::deque<BeanRecord> records;
+    size_t dropped = 0;
+    bool failed = false;
+
+private:
+    static inline thread_local BeanRequestScope* _current = nullptr;
+};
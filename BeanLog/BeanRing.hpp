@@ -0,0 +1,67 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanRing is a bounded, lock-free, single-producer/single-consumer queue.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t CAPACITY>
+class BeanRing
+{
+    static_assert(CAPACITY && (CAPACITY & (CAPACITY - 1)) == 0, "BeanRing capacity must be a power of two.");
+
+public:
+    /* Producer side, fails instead of blocking when the ring is full. */
+    bool TryPush(const T& item) noexcept
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+
+        // Only look at the consumer's cache line when the cached view says we're full
+        if (head - _cachedTail >= CAPACITY)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head - _cachedTail >= CAPACITY)
+            {
+                return false;
+            }
+        }
+
+        _items[head & (CAPACITY - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side, hands every queued item to `fn` and returns how many there were. */
+    template <typename FN>
+    size_t Drain(FN&& fn)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t head = _head.load(std::memory_order_acquire);
+
+        for (size_t i = tail; i != head; ++i)
+        {
+            fn(_items[i & (CAPACITY - 1)]);
+        }
+
+        _tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    bool IsEmpty(void) const noexcept
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // Producer and consumer indices live on separate cache lines to avoid false sharing
+    alignas(64) std::atomic<size_t> _head = 0;
+    size_t _cachedTail = 0;
+    alignas(64) std::atomic<size_t> _tail = 0;
+    alignas(64) T _items[CAPACITY]{};
+};
@@ -0,0 +1,347 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanShared hands messages over to another process through a ring in shared memory, see `beanlog-collect`.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "BeanField.hpp"
+#include "BeanRecord.hpp"
+
+// The counters are shared between processes, they can't fall back to a lock
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "BeanShared needs lock-free 64-bit atomics.");
+
+/* Opens the shared memory, the ring's bytes follow it. Only the counters change once the producer has set it up. */
+struct BeanSharedHeader
+{
+    static constexpr uint32_t Signature = 0x4D485342; // "BSHM"
+
+    // Stored last, the collector doesn't look any further until it's there
+    std::atomic<uint32_t> signature;
+    uint32_t pid;
+    uint64_t capacity;
+
+    // Producer and collector counters live on separate cache lines, as in `BeanRing`
+    alignas(64) std::atomic<uint64_t> head;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint32_t> isClosed;
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> collector;
+};
+
+/* A `kv` field as it's stored in the ring, its string and key follow the record's text. */
+struct BeanSharedField
+{
+    BeanValueType type;
+    uint8_t reserved;
+    uint16_t keyLength;
+    uint32_t stringLength;
+    uint64_t bits;
+};
+
+/*
+    A message in the ring, followed by its fields, the category's name, the message, the fields' strings and
+    their keys. Records are 8-byte aligned and never wrap, the end of the ring is skipped when the next one doesn't fit,
+    with a padding record if there's room for one.
+*/
+struct BeanSharedRecord
+{
+    uint32_t size;
+    uint8_t level;
+    uint8_t isPadding;
+    uint16_t fieldCount;
+    int64_t time;
+    uint32_t syserr;
+    uint32_t categoryLength;
+    uint32_t messageLength;
+    uint32_t reserved;
+
+    /* Bytes needed to pack a record, see `Pack`. */
+    static size_t GetSize(std::wstring_view category, std::wstring_view message, std::span<const BeanField> context, std::span<const BeanField> fields) noexcept
+    {
+        size_t keys = 0;
+        for (const std::span<const BeanField> span : {context, fields})
+        {
+            for (const BeanField& field : span)
+            {
+                keys += strlen(field.key) + 1;
+            }
+        }
+
+        const size_t count = context.size() + fields.size();
+        const size_t text = category.size() + message.size() + BeanField::StringSize(context) + BeanField::StringSize(fields);
+        return (sizeof(BeanSharedRecord) + count * sizeof(BeanSharedField) + text * sizeof(wchar_t) + keys + 7) & ~size_t{7};
+    }
+
+    /* `time` is UTC, in nanoseconds since the epoch. The context's fields come first, as they're written. */
+    static void Pack(void* out, size_t size, std::wstring_view category, BeanLogLevel level, int64_t time, DWORD syserr, std::wstring_view message, std::span<const BeanField> context, std::span<const BeanField> fields) noexcept
+    {
+        const uint16_t count = static_cast<uint16_t>(context.size() + fields.size());
+        BeanSharedRecord* record = new (out) BeanSharedRecord{static_cast<uint32_t>(size), static_cast<uint8_t>(level), 0, count, time, static_cast<uint32_t>(syserr), static_cast<uint32_t>(category.size()), static_cast<uint32_t>(message.size()), 0};
+
+        BeanSharedField* packed = reinterpret_cast<BeanSharedField*>(record + 1);
+        wchar_t* text = std::copy(message.begin(), message.end(), std::copy(category.begin(), category.end(), reinterpret_cast<wchar_t*>(packed + count)));
+        for (const std::span<const BeanField> span : {context, fields})
+        {
+            for (const BeanField& field : span)
+            {
+                packed->type = field.value.type;
+                packed->reserved = 0;
+                packed->keyLength = static_cast<uint16_t>(strlen(field.key));
+                packed->stringLength = 0;
+                if (field.value.type == BeanValueType::string)
+                {
+                    packed->stringLength = static_cast<uint32_t>(field.value.string.size());
+                    packed->bits = 0;
+                    text = std::copy(field.value.string.begin(), field.value.string.end(), text);
+                }
+                else
+                {
+                    memcpy(&packed->bits, &field.value.int64, sizeof(packed->bits));
+                }
+                ++packed;
+            }
+        }
+
+        // Keys go last, they're the only thing that isn't a multiple of two bytes
+        char* keys = reinterpret_cast<char*>(text);
+        for (const std::span<const BeanField> span : {context, fields})
+        {
+            for (const BeanField& field : span)
+            {
+                const size_t length = strlen(field.key) + 1;
+                memcpy(keys, field.key, length);
+                keys += length;
+            }
+        }
+    }
+
+    /*
+        True if the fields, the text and the keys the header describes all fit within `size`. The collector checks
+        before reading any of them, a ring written over by anything but BeanLog mustn't send it past the record.
+    */
+    bool IsIntact(void) const noexcept
+    {
+        uint64_t bytes = sizeof(BeanSharedRecord) + uint64_t{fieldCount} * sizeof(BeanSharedField);
+        if (bytes > size)
+        {
+            return false;
+        }
+
+        const BeanSharedField* packed = reinterpret_cast<const BeanSharedField*>(this + 1);
+        uint64_t text = uint64_t{categoryLength} + messageLength;
+        for (size_t i = 0; i < fieldCount; ++i)
+        {
+            text += packed[i].stringLength;
+            bytes += packed[i].keyLength + 1;
+        }
+        return bytes + text * sizeof(wchar_t) <= size;
+    }
+
+    std::wstring_view GetCategory(void) const noexcept
+    {
+        return {reinterpret_cast<const wchar_t*>(reinterpret_cast<const BeanSharedField*>(this + 1) + fieldCount), categoryLength};
+    }
+
+    std::wstring_view GetText(void) const noexcept
+    {
+        return {GetCategory().data() + categoryLength, messageLength};
+    }
+
+    /* Rebuilds the record's fields into `out`, their keys and strings point into the record. */
+    void GetFields(std::vector<BeanField>& out) const
+    {
+        const BeanSharedField* packed = reinterpret_cast<const BeanSharedField*>(this + 1);
+        const wchar_t* text = GetText().data() + messageLength;
+        size_t strings = 0;
+        for (size_t i = 0; i < fieldCount; ++i)
+        {
+            strings += packed[i].stringLength;
+        }
+
+        const char* keys = reinterpret_cast<const char*>(text + strings);
+        out.resize(fieldCount);
+        for (BeanField& field : out)
+        {
+            field.key = keys;
+            field.value.type = packed->type;
+            if (packed->type == BeanValueType::string)
+            {
+                field.value.string = {text, packed->stringLength};
+                text += packed->stringLength;
+            }
+            else
+            {
+                memcpy(&field.value.int64, &packed->bits, sizeof(packed->bits));
+            }
+            keys += packed->keyLength + 1;
+            ++packed;
+        }
+    }
+};
+
+/*
+    Producer side of the ring, it has a single producer: BeanLog, which writes to it under its lock. When the ring is
+    full, messages wait for an attached collector to make room, like async records wait for the backend. They're
+    dropped and counted if there's no collector, or if it stops making progress for `_stallLimit`.
+*/
+class BeanSharedSink
+{
+public:
+    /* Creates the shared memory named `name`, the ring gets `bytes` rounded up to a power of two. */
+    BeanSharedSink(const wchar_t* name, size_t bytes)
+    {
+        _capacity = std::bit_ceil((std::max<size_t>)(bytes, 64 * 1024));
+        const uint64_t total = sizeof(BeanSharedHeader) + _capacity;
+
+        _mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(total >> 32), static_cast<DWORD>(total), name);
+        if (!_mapping)
+        {
+            MessageBoxW(nullptr, L"Failed to create the shared ring.", L"BeanSharedSink::BeanSharedSink", MB_ICONERROR | MB_OK);
+            return;
+        }
+
+        // Another process owns it, or a collector still holds on to the one a previous run left behind
+        if (GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+            MessageBoxW(nullptr, L"The shared ring is already in use.", L"BeanSharedSink::BeanSharedSink", MB_ICONERROR | MB_OK);
+            CloseHandle(_mapping);
+            _mapping = nullptr;
+            return;
+        }
+
+        void* view = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        if (!view)
+        {
+            MessageBoxW(nullptr, L"Failed to map the shared ring.", L"BeanSharedSink::BeanSharedSink", MB_ICONERROR | MB_OK);
+            return;
+        }
+
+        _header = new (view) BeanSharedHeader{};
+        _header->pid = GetCurrentProcessId();
+        _header->capacity = _capacity;
+        _header->signature.store(BeanSharedHeader::Signature, std::memory_order_release);
+        _ring = reinterpret_cast<char*>(_header + 1);
+    }
+
+    /* The collector writes out whatever is left and lets go of the memory once it sees the ring closed. */
+    ~BeanSharedSink()
+    {
+        if (_header)
+        {
+            _header->isClosed.store(1, std::memory_order_release);
+            UnmapViewOfFile(_header);
+        }
+
+        if (_mapping)
+        {
+            CloseHandle(_mapping);
+        }
+    }
+
+    bool IsOpen(void) const noexcept
+    {
+        return _header != nullptr;
+    }
+
+    /* Copies a message into the ring, `time` is UTC in nanoseconds since the epoch. */
+    void Write(std::wstring_view category, BeanLogLevel level, int64_t time, DWORD syserr, std::wstring_view message, std::span<const BeanField> context, std::span<const BeanField> fields) noexcept
+    {
+        // Larger than the whole ring, there's no point in waiting for the collector
+        const size_t size = BeanSharedRecord::GetSize(category, message, context, fields);
+        if (size > _capacity)
+        {
+            _header->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // The end of the ring is skipped on its own, the record then waits for room at the start
+        uint64_t head = _header->head.load(std::memory_order_relaxed);
+        const size_t left = _capacity - (head & (_capacity - 1));
+        if (left < size)
+        {
+            if (!_HasRoom(head + left))
+            {
+                _header->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            if (left >= sizeof(BeanSharedRecord))
+            {
+                new (_ring + (head & (_capacity - 1))) BeanSharedRecord{static_cast<uint32_t>(left), 0, 1, 0, 0, 0, 0, 0, 0};
+            }
+            head += left;
+            _header->head.store(head, std::memory_order_release);
+        }
+
+        if (!_HasRoom(head + size))
+        {
+            _header->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        BeanSharedRecord::Pack(_ring + (head & (_capacity - 1)), size, category, level, time, syserr, message, context, fields);
+        _header->head.store(head + size, std::memory_order_release);
+    }
+
+    BeanSharedSink(const BeanSharedSink&) = delete;
+    BeanSharedSink(BeanSharedSink&&) = delete;
+    BeanSharedSink& operator=(const BeanSharedSink&) = delete;
+    BeanSharedSink& operator=(BeanSharedSink&&) = delete;
+
+private:
+    /* Only looks at the collector's cache line when the cached view says the ring is full. */
+    bool _HasRoom(uint64_t end) noexcept
+    {
+        return end - _cachedTail <= _capacity || _WaitForRoom(end);
+    }
+
+    /* True once the ring has room up to `end`. A collector that timed out isn't waited for again until it moves. */
+    bool _WaitForRoom(uint64_t end) noexcept
+    {
+        const auto deadline = std::chrono::steady_clock::now() + _stallLimit;
+        for (;;)
+        {
+            _cachedTail = _header->tail.load(std::memory_order_acquire);
+            if (end - _cachedTail <= _capacity)
+            {
+                return true;
+            }
+
+            if (!_header->collector.load(std::memory_order_relaxed) || _cachedTail == _stalledTail || std::chrono::steady_clock::now() >= deadline)
+            {
+                _stalledTail = _cachedTail;
+                return false;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    static constexpr std::chrono::seconds _stallLimit{1};
+
+    HANDLE _mapping = nullptr;
+    BeanSharedHeader* _header = nullptr;
+    char* _ring = nullptr;
+    size_t _capacity = 0;
+    uint64_t _cachedTail = 0;
+    uint64_t _stalledTail = UINT64_MAX;
+};
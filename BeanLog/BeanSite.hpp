@@ -0,0 +1,370 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanSite describes every `bean_*` call site, each can be switched on or off at runtime.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cwctype>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BeanRecord.hpp"
+
+class BeanCategory;
+
+enum class BeanSiteState : uint8_t
+{
+    level,  // Follows the level of the site's category
+    on,     // Always logs, whatever the level
+    off     // Never logs
+};
+
+/* Static descriptor owned by every expansion of a `bean_*` macro. */
+class BeanLogSite
+{
+public:
+    /* Defined along with `BeanCategory`, registration needs the category's level. */
+    BeanLogSite(const BeanCategory& category, BeanLogLevel level, const wchar_t* file, int line, const wchar_t* function, const wchar_t* format);
+
+    /* Sites of an unloaded module must not be left dangling in the list, defined along with `BeanSites`. */
+    ~BeanLogSite();
+
+    bool IsEnabled(void) const noexcept
+    {
+        return _flags.load(std::memory_order_relaxed) & _enabledFlag;
+    }
+
+    /*
+        What the macros check first, a single load decides whether the message is enabled. Calls are only
+        counted while `BeanSites::SetCounting` is on, they go through the same load to find out.
+    */
+    bool Check(void) noexcept
+    {
+        const uint8_t flags = _flags.load(std::memory_order_relaxed);
+        if (flags & _countedFlag)
+        {
+            _calls.fetch_add(1, std::memory_order_relaxed);
+        }
+        return flags & _enabledFlag;
+    }
+
+    const BeanCategory& GetCategory(void) const noexcept
+    {
+        return _category;
+    }
+
+    BeanLogLevel GetLevel(void) const noexcept
+    {
+        return _level;
+    }
+
+    const wchar_t* GetFile(void) const noexcept
+    {
+        return _file;
+    }
+
+    int GetLine(void) const noexcept
+    {
+        return _line;
+    }
+
+    const wchar_t* GetFunction(void) const noexcept
+    {
+        return _function;
+    }
+
+    const wchar_t* GetFormat(void) const noexcept
+    {
+        return _format;
+    }
+
+    BeanSiteState GetState(void) const noexcept
+    {
+        return _state.load(std::memory_order_relaxed);
+    }
+
+    /* A message that made it past the filter, along with its size and the ticks it took to format. */
+    void CountMessage(uint64_t bytes, uint64_t ticks) noexcept
+    {
+        _emitted.fetch_add(1, std::memory_order_relaxed);
+        _bytes.fetch_add(bytes, std::memory_order_relaxed);
+        _formatTicks.fetch_add(ticks, std::memory_order_relaxed);
+    }
+
+    uint64_t GetCalls(void) const noexcept
+    {
+        return _calls.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetEmitted(void) const noexcept
+    {
+        return _emitted.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetBytes(void) const noexcept
+    {
+        return _bytes.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetFormatTicks(void) const noexcept
+    {
+        return _formatTicks.load(std::memory_order_relaxed);
+    }
+
+public:
+    BeanLogSite(const BeanLogSite&) = delete;
+    BeanLogSite(BeanLogSite&&) = delete;
+    BeanLogSite& operator=(const BeanLogSite&) = delete;
+    BeanLogSite& operator=(BeanLogSite&&) = delete;
+
+private:
+    friend class BeanSites;
+
+    void _Refresh(BeanLogLevel categoryLevel, bool counted) noexcept
+    {
+        const BeanSiteState state = GetState();
+        const bool enabled = state == BeanSiteState::on || (state == BeanSiteState::level && _level >= categoryLevel);
+        _flags.store((enabled ? _enabledFlag : 0) | (counted ? _countedFlag : 0), std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint8_t _enabledFlag = 1;
+    static constexpr uint8_t _countedFlag = 2;
+
+    const BeanCategory& _category;
+    const BeanLogLevel _level;
+    const wchar_t* const _file;
+    const int _line;
+    const wchar_t* const _function;
+    const wchar_t* const _format;
+    std::atomic<uint8_t> _flags = 0;
+    std::atomic<BeanSiteState> _state = BeanSiteState::level;
+    BeanLogSite* _next = nullptr;
+
+    // Written on every call while counting, kept off the cache line that the check reads
+    alignas(64) std::atomic<uint64_t> _calls = 0;
+    std::atomic<uint64_t> _emitted = 0;
+    std::atomic<uint64_t> _bytes = 0;
+    std::atomic<uint64_t> _formatTicks = 0;
+};
+
+/* What a site counted and where it is, copied so that it outlives the site. */
+struct BeanSiteStats
+{
+    std::wstring file;
+    int line = 0;
+    std::wstring function;
+    uint64_t calls = 0;
+    uint64_t emitted = 0;
+    uint64_t bytes = 0;
+    uint64_t formatTicks = 0;
+};
+
+/*
+    Registry of every site that ran at least once. Rules are kept around and applied
+    to sites as they register, static descriptors are only constructed on first use.
+*/
+class BeanSites
+{
+public:
+    /*
+        Sets the state of every site whose file and function match the patterns, `*` and `?`
+        are supported. A file pattern without a path separator only matches the file name.
+        Returns the number of sites that matched so far.
+    */
+    static size_t SetState(std::wstring_view filePattern, std::wstring_view functionPattern, BeanSiteState state)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _rules.push_back({std::wstring(filePattern), std::wstring(functionPattern), state});
+
+        size_t matched = 0;
+        for (BeanLogSite* site = _head; site; site = site->_next)
+        {
+            if (_Matches(_rules.back(), *site))
+            {
+                site->_state.store(state, std::memory_order_relaxed);
+                site->_Refresh(_GetCategoryLevel(*site), _isCounting);
+                ++matched;
+            }
+        }
+        return matched;
+    }
+
+    /* Visits every registered site, `fn` must not log. */
+    template <typename FN>
+    static void ForEach(FN&& fn)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (BeanLogSite* site = _head; site; site = site->_next)
+        {
+            fn(*site);
+        }
+    }
+
+    /* Every site that counted anything, including the ones that are gone already. */
+    static std::vector<BeanSiteStats> GetStats(void)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        std::vector<BeanSiteStats> stats = _retired;
+        for (BeanLogSite* site = _head; site; site = site->_next)
+        {
+            if (site->GetCalls() || site->GetEmitted())
+            {
+                stats.push_back(_GetStats(*site));
+            }
+        }
+        return stats;
+    }
+
+    /* Starts or stops counting every site's calls, enabled or not. Counting makes every call write to its site. */
+    static void SetCounting(bool counting)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isCounting = counting;
+        for (BeanLogSite* site = _head; site; site = site->_next)
+        {
+            site->_Refresh(_GetCategoryLevel(*site), counting);
+        }
+    }
+
+    /* Called by `BeanCategory` whenever its level changes. */
+    static void Refresh(const BeanCategory& category, BeanLogLevel level)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (BeanLogSite* site = _head; site; site = site->_next)
+        {
+            if (&site->_category == &category)
+            {
+                site->_Refresh(level, _isCounting);
+            }
+        }
+    }
+
+    static void Add(BeanLogSite& site)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // Later rules win, just like they would have if the site had been there already
+        for (const _Rule& rule : _rules)
+        {
+            if (_Matches(rule, site))
+            {
+                site._state.store(rule.state, std::memory_order_relaxed);
+            }
+        }
+
+        site._Refresh(_GetCategoryLevel(site), _isCounting);
+        site._next = _head;
+        _head = &site;
+    }
+
+    /*
+        Sites are destroyed along with their module, or at exit, which is usually before `~BeanLog`
+        gets to report them. Their counts are kept so that the report still includes them.
+    */
+    static void Remove(BeanLogSite& site)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (BeanLogSite** it = &_head; *it; it = &(*it)->_next)
+        {
+            if (*it == &site)
+            {
+                *it = site._next;
+                break;
+            }
+        }
+
+        if (site.GetCalls() || site.GetEmitted())
+        {
+            _retired.push_back(_GetStats(site));
+        }
+    }
+
+    /* Iterative `*`/`?` matching with single-star backtracking, case-insensitive as Windows paths are. */
+    static bool Glob(std::wstring_view pattern, std::wstring_view text) noexcept
+    {
+        size_t p = 0;
+        size_t t = 0;
+        size_t star = std::wstring_view::npos;
+        size_t resume = 0;
+
+        while (t < text.size())
+        {
+            if (p < pattern.size() && (pattern[p] == L'?' || std::towlower(pattern[p]) == std::towlower(text[t])))
+            {
+                ++p;
+                ++t;
+            }
+            else if (p < pattern.size() && pattern[p] == L'*')
+            {
+                star = p++;
+                resume = t;
+            }
+            else if (star != std::wstring_view::npos)
+            {
+                p = star + 1;
+                t = ++resume;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        while (p < pattern.size() && pattern[p] == L'*')
+        {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+
+private:
+    struct _Rule
+    {
+        std::wstring file;
+        std::wstring function;
+        BeanSiteState state;
+    };
+
+    static bool _Matches(const _Rule& rule, const BeanLogSite& site) noexcept
+    {
+        std::wstring_view file = site._file;
+        if (rule.file.find_first_of(L"\\/") == std::wstring::npos)
+        {
+            file = file.substr(file.find_last_of(L"\\/") + 1);
+        }
+
+        return Glob(rule.file, file) && Glob(rule.function, site._function);
+    }
+
+    static BeanSiteStats _GetStats(const BeanLogSite& site)
+    {
+        return {site._file, site._line, site._function, site.GetCalls(), site.GetEmitted(), site.GetBytes(), site.GetFormatTicks()};
+    }
+
+    /* Defined along with `BeanCategory`. */
+    static BeanLogLevel _GetCategoryLevel(const BeanLogSite& site) noexcept;
+
+private:
+    static inline std::mutex _mutex;
+    static inline BeanLogSite* _head = nullptr;
+    static inline std::vector<_Rule> _rules;
+    static inline std::vector<BeanSiteStats> _retired;
+    static inline bool _isCounting = false;
+};
+
+inline BeanLogSite::~BeanLogSite()
+{
+    BeanSites::Remove(*this);
+}
@@ -0,0 +1,190 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanSlab hands out record storage without going through the global heap.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/*
+    Per-thread pool of fixed-size blocks, only its owning thread allocates from it. Blocks
+    are carved out of chunks reserved with VirtualAlloc and come back from the backend in
+    batches, one exchange per drain. Requests past the largest size class go to the heap.
+*/
+class BeanSlab
+{
+    struct _Block;
+
+public:
+    static constexpr size_t classes = 4;
+    static constexpr size_t classSizes[classes] = {64, 256, 1024, 4096};
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    /* Blocks released by the consumer, returned to their slab all at once. */
+    class Batch
+    {
+    private:
+        friend class BeanSlab;
+
+        _Block* _first = nullptr;
+        _Block* _last = nullptr;
+    };
+
+    BeanSlab() = default;
+
+    /* Every block has been returned by the time the owning thread's state is freed. */
+    ~BeanSlab()
+    {
+        while (_chunks)
+        {
+            void* next = *static_cast<void**>(_chunks);
+            VirtualFree(_chunks, 0, MEM_RELEASE);
+            _chunks = next;
+        }
+    }
+
+    /* Producer side, returns `nullptr` if a new chunk couldn't be reserved. */
+    void* Allocate(size_t bytes)
+    {
+        size_t cls = 0;
+        while (cls < classes && classSizes[cls] < bytes + sizeof(_Block))
+        {
+            ++cls;
+        }
+
+        if (cls == classes)
+        {
+            _heapFallbacks.fetch_add(1, std::memory_order_relaxed);
+            _Block* block = static_cast<_Block*>(::operator new(sizeof(_Block) + bytes, std::nothrow));
+            if (!block)
+            {
+                return nullptr;
+            }
+
+            block->cls = classes;
+            return block + 1;
+        }
+
+        if (!_free[cls])
+        {
+            _Reclaim();
+        }
+        if (!_free[cls] && !_Carve(cls))
+        {
+            return nullptr;
+        }
+
+        _Block* block = _free[cls];
+        _free[cls] = block->next;
+        block->cls = cls;
+        return block + 1;
+    }
+
+    /* Consumer side, heap blocks are freed right away while the others wait for `Return`. */
+    static void Release(void* ptr, Batch& batch) noexcept
+    {
+        _Block* block = static_cast<_Block*>(ptr) - 1;
+        if (block->cls == classes)
+        {
+            ::operator delete(block);
+            return;
+        }
+
+        block->next = batch._first;
+        batch._first = block;
+        if (!batch._last)
+        {
+            batch._last = block;
+        }
+    }
+
+    /* Consumer side, `batch` must only hold blocks allocated from this slab. */
+    void Return(Batch& batch) noexcept
+    {
+        if (!batch._first)
+        {
+            return;
+        }
+
+        _Block* head = _returned.load(std::memory_order_relaxed);
+        do
+        {
+            batch._last->next = head;
+        } while (!_returned.compare_exchange_weak(head, batch._first, std::memory_order_release, std::memory_order_relaxed));
+
+        batch._first = nullptr;
+        batch._last = nullptr;
+    }
+
+    /* Allocations that didn't fit any size class since the last call. */
+    uint64_t TakeHeapFallbacks(void) noexcept
+    {
+        return _heapFallbacks.exchange(0, std::memory_order_relaxed);
+    }
+
+public:
+    BeanSlab(const BeanSlab&) = delete;
+    BeanSlab(BeanSlab&&) = delete;
+    BeanSlab& operator=(const BeanSlab&) = delete;
+    BeanSlab& operator=(BeanSlab&&) = delete;
+
+private:
+    // Keeps what follows it 16-byte aligned
+    struct _Block
+    {
+        _Block* next;
+        size_t cls;
+    };
+
+    /* Moves whatever the consumer returned onto the free lists of the right size class. */
+    void _Reclaim(void) noexcept
+    {
+        _Block* block = _returned.exchange(nullptr, std::memory_order_acquire);
+        while (block)
+        {
+            _Block* next = block->next;
+            block->next = _free[block->cls];
+            _free[block->cls] = block;
+            block = next;
+        }
+    }
+
+    /* The first cache line of a chunk links it to the previous one, the rest is split into blocks of a single class. */
+    bool _Carve(size_t cls) noexcept
+    {
+        void* chunk = VirtualAlloc(nullptr, chunkSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!chunk)
+        {
+            return false;
+        }
+
+        *static_cast<void**>(chunk) = _chunks;
+        _chunks = chunk;
+
+        char* const end = static_cast<char*>(chunk) + chunkSize;
+        for (char* it = static_cast<char*>(chunk) + 64; it + classSizes[cls] <= end; it += classSizes[cls])
+        {
+            _Block* block = reinterpret_cast<_Block*>(it);
+            block->next = _free[cls];
+            _free[cls] = block;
+        }
+        return true;
+    }
+
+private:
+    _Block* _free[classes]{};
+    void* _chunks = nullptr;
+    std::atomic<uint64_t> _heapFallbacks = 0;
+
+    // Written by the consumer only
+    alignas(64) std::atomic<_Block*> _returned = nullptr;
+};
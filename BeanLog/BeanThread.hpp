@@ -0,0 +1,218 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanThread keeps the per-thread buffers that BeanLog's backend drains.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "BeanContext.hpp"
+#include "BeanProfile.hpp"
+#include "BeanRecord.hpp"
+#include "BeanRing.hpp"
+#include "BeanSlab.hpp"
+#include "BeanTrace.hpp"
+
+/* Everything a producer thread writes without taking a lock, only the backend reads it back. */
+struct BeanThreadState
+{
+    /* Returns the calling thread's state, registering it on first use. */
+    static BeanThreadState& Current(void);
+
+    DWORD tid = GetCurrentThreadId();
+    uint32_t depth = 0;
+    std::atomic<uint64_t> droppedSpans = 0;
+    std::atomic<bool> retired = false;
+    BeanRing<BeanSpan, 4096> spans;
+
+    // Producers write to `profile[epoch & 1]` while the backend collects the other half
+    BeanScopeTable profile[2];
+
+    // Async mode, records are allocated from `slab` and handed back to it once written
+    BeanSlab slab;
+    BeanRing<BeanPackedRecord*, 1024> records;
+
+    // Warnings and failures, drained ahead of `records`
+    BeanRing<BeanPackedRecord*, 256> urgent;
+
+    // Set while a message has its timestamp but isn't queued yet, the backend doesn't merge past it until then
+    std::atomic<uint64_t> inFlight = UINT64_MAX;
+
+    // Backend only, the key of the last record merged, how many merged ones are still waiting to be written, and the
+    // blocks written since the last drain
+    uint64_t mergeTicks = 0;
+    size_t unwritten = 0;
+    BeanSlab::Batch released;
+
+    // Only the owner pushes and pops, records carry the top of the stack when they're queued
+    BeanContext context;
+
+    // Set once the calling thread's thread-locals are being destroyed, its state may already be gone by then and
+    // messages logged from the remaining destructors must not bring it back
+    static inline thread_local bool exiting = false;
+};
+
+class BeanThreadRegistry
+{
+public:
+    static BeanThreadRegistry& Get(void)
+    {
+        static BeanThreadRegistry Registry;
+        return Registry;
+    }
+
+    void Add(BeanThreadState* state)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _states.push_back(state);
+    }
+
+    /* Visits every registered thread, states are left in place whatever they still hold. */
+    template <typename FN>
+    void ForEach(FN&& fn)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (BeanThreadState* state : _states)
+        {
+            fn(*state);
+        }
+    }
+
+    /*
+        Visits every registered thread for the backend's drain, `done` runs once every thread has been visited. States
+        of exited threads are freed afterwards, once their queues are empty and none of their records is left unwritten.
+    */
+    template <typename FN, typename DONE>
+    void ForEach(FN&& fn, DONE&& done)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _retired.clear();
+        for (BeanThreadState* state : _states)
+        {
+            // Read the flag first, whatever the thread pushed before exiting is then visible to `fn`
+            _retired.push_back(state->retired.load(std::memory_order_acquire));
+            fn(*state);
+        }
+
+        done();
+
+        size_t kept = 0;
+        for (size_t i = 0; i < _states.size(); ++i)
+        {
+            if (_retired[i] && _IsDrained(*_states[i]))
+            {
+                delete _states[i];
+            }
+            else
+            {
+                _states[kept++] = _states[i];
+            }
+        }
+        _states.resize(kept);
+    }
+
+public:
+    BeanThreadRegistry(const BeanThreadRegistry&) = delete;
+    BeanThreadRegistry(BeanThreadRegistry&&) = delete;
+    BeanThreadRegistry& operator=(const BeanThreadRegistry&) = delete;
+    BeanThreadRegistry& operator=(BeanThreadRegistry&&) = delete;
+
+protected:
+    BeanThreadRegistry() = default;
+
+    /*
+        States still registered here belong to threads that outlived the process' static
+        destructors, they're intentionally leaked as those threads may still write to them.
+    */
+    ~BeanThreadRegistry() = default;
+
+private:
+    static bool _IsDrained(const BeanThreadState& state) noexcept
+    {
+        return !state.unwritten && state.records.IsEmpty() && state.urgent.IsEmpty() && state.spans.IsEmpty();
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<BeanThreadState*> _states;
+    std::vector<bool> _retired;
+};
+
+inline BeanThreadState& BeanThreadState::Current(void)
+{
+    // Owns the registration, the backend frees the state once the thread is gone and it's been drained
+    struct Owner
+    {
+        Owner() : state(new BeanThreadState)
+        {
+            BeanThreadRegistry::Get().Add(state);
+        }
+
+        ~Owner()
+        {
+            exiting = true;
+            state->retired.store(true, std::memory_order_release);
+        }
+
+        BeanThreadState* state;
+    };
+
+    thread_local Owner owner;
+    return *owner.state;
+}
+
+/* Pushes a field onto the calling thread's context for the lifetime of the enclosing scope, see `bean_context`. */
+class BeanContextScope
+{
+public:
+    explicit BeanContextScope(const BeanField& field) noexcept
+    {
+        // Scopes opened from thread-local destructors push nothing, the context may already be gone
+        if (BeanThreadState::exiting)
+        {
+            return;
+        }
+
+        if (!_current)
+        {
+            _current = &BeanThreadState::Current().context;
+        }
+        _context = _current;
+        _context->Push(field);
+    }
+
+    ~BeanContextScope()
+    {
+        if (_context)
+        {
+            _context->Pop();
+        }
+    }
+
+    /* `nullptr` until the calling thread pushes something, threads that never do don't pay for a state. */
+    static BeanContext* GetCurrent(void) noexcept
+    {
+        return BeanThreadState::exiting ? nullptr : _current;
+    }
+
+    BeanContextScope(const BeanContextScope&) = delete;
+    BeanContextScope(BeanContextScope&&) = delete;
+    BeanContextScope& operator=(const BeanContextScope&) = delete;
+    BeanContextScope& operator=(BeanContextScope&&) = delete;
+
+private:
+    BeanContext* _context = nullptr;
+
+    static inline thread_local BeanContext* _current = nullptr;
+};
@@ -0,0 +1,148 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanTrace writes scoped spans as Chrome/Perfetto trace-event JSON.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+
+/* What `bean_scope` leaves behind, `name` must have static storage duration. */
+struct BeanSpan
+{
+    const wchar_t* name;
+    uint64_t begin;
+    uint64_t end;
+    uint32_t depth;
+};
+
+class BeanTraceSink
+{
+public:
+    using SysTime = std::chrono::sys_time<std::chrono::nanoseconds>;
+
+    explicit BeanTraceSink(const wchar_t* path)
+    {
+        _file = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE)
+        {
+            MessageBoxW(nullptr, L"Failed to create the trace file.", L"BeanTraceSink::BeanTraceSink", MB_ICONERROR | MB_OK);
+            return;
+        }
+
+        // The JSON array format doesn't need the closing `]`, traces cut short by a crash still load
+        _buffer = "[\n";
+    }
+
+    ~BeanTraceSink()
+    {
+        if (IsOpen())
+        {
+            _buffer += "\n]\n";
+            Flush();
+            CloseHandle(_file);
+        }
+    }
+
+    bool IsOpen(void) const noexcept
+    {
+        return _file != INVALID_HANDLE_VALUE;
+    }
+
+    /*
+        Appends a complete ("X") event, timestamps are relative to when the sink was opened. The duration comes
+        from the span's ticks, converting both ends could straddle a re-synchronization with the system clock.
+    */
+    void Write(const BeanSpan& span, DWORD tid, SysTime begin, std::chrono::nanoseconds duration)
+    {
+        const double ts = std::chrono::duration<double, std::micro>(begin - _origin).count();
+        const double dur = std::chrono::duration<double, std::micro>(duration).count();
+
+        std::format_to(std::back_inserter(_buffer),
+                       "{}{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{},\"args\":{{\"depth\":{}}}}}",
+                       _events++ ? ",\n" : "", _GetName(span.name), ts, dur, _pid, tid, span.depth);
+
+        if (_buffer.size() >= _flushThreshold)
+        {
+            Flush();
+        }
+    }
+
+    void Flush(void)
+    {
+        if (!IsOpen() || _buffer.empty())
+        {
+            return;
+        }
+
+        DWORD written = 0;
+        WriteFile(_file, _buffer.data(), static_cast<DWORD>(_buffer.size()), &written, nullptr);
+        _buffer.clear();
+    }
+
+private:
+    /* Span names are string literals, each one only gets converted and escaped once. */
+    const std::string& _GetName(const wchar_t* name)
+    {
+        auto [it, inserted] = _names.try_emplace(name);
+        if (!inserted)
+        {
+            return it->second;
+        }
+
+        std::string utf8(WideCharToMultiByte(CP_UTF8, 0, name, -1, nullptr, 0, nullptr, nullptr), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, name, -1, utf8.data(), static_cast<int>(utf8.size()), nullptr, nullptr);
+
+        for (const char c : utf8)
+        {
+            switch (c)
+            {
+                case '\0':
+                {
+                    break;
+                }
+                case '"':
+                case '\\':
+                {
+                    it->second += '\\';
+                    it->second += c;
+                    break;
+                }
+                default:
+                {
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        std::format_to(std::back_inserter(it->second), "\\u{:04x}", static_cast<int>(c));
+                    }
+                    else
+                    {
+                        it->second += c;
+                    }
+                    break;
+                }
+            }
+        }
+
+        return it->second;
+    }
+
+private:
+    static constexpr size_t _flushThreshold = 64 * 1024;
+
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    DWORD _pid = GetCurrentProcessId();
+    SysTime _origin = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now());
+    uint64_t _events = 0;
+    std::string _buffer;
+    std::unordered_map<const wchar_t*, std::string> _names;
+};
@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanWorkers is the pool of threads that help BeanLog's backend format deferred records.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of threads that run one job at a time alongside the thread that hands it out. */
+class BeanWorkers
+{
+public:
+    explicit BeanWorkers(size_t count)
+    {
+        _threads.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            _threads.emplace_back(&BeanWorkers::_Main, this, i + 1);
+        }
+    }
+
+    ~BeanWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+
+        for (std::thread& thread : _threads)
+        {
+            thread.join();
+        }
+    }
+
+    /* Parts a job is split into, the calling thread counts as one. */
+    size_t GetCount(void) const noexcept
+    {
+        return _threads.size() + 1;
+    }
+
+    /* Runs `job(part)` for every part in [0, `GetCount()`), the calling thread takes part 0. Returns once every part is done. */
+    void Run(const std::function<void(size_t)>& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job = &job;
+            _remaining = _threads.size();
+            ++_generation;
+        }
+        _wake.notify_all();
+
+        job(0);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this] { return _remaining == 0; });
+        _job = nullptr;
+    }
+
+public:
+    BeanWorkers(const BeanWorkers&) = delete;
+    BeanWorkers(BeanWorkers&&) = delete;
+    BeanWorkers& operator=(const BeanWorkers&) = delete;
+    BeanWorkers& operator=(BeanWorkers&&) = delete;
+
+private:
+    void _Main(size_t part)
+    {
+        uint64_t generation = 0;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _wake.wait(lock, [&] { return _stopping || _generation != generation; });
+            if (_stopping)
+            {
+                return;
+            }
+            generation = _generation;
+
+            const std::function<void(size_t)>& job = *_job;
+            lock.unlock();
+            job(part);
+            lock.lock();
+
+            if (--_remaining == 0)
+            {
+                _done.notify_one();
+            }
+        }
+    }
+
+private:
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(size_t)>* _job = nullptr;
+    size_t _remaining = 0;
+    uint64_t _generation = 0;
+    bool _stopping = false;
+};
@@ -0,0 +1,239 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanLines splits BeanLog's output back into lines and reads their timestamps, levels and categories, for the tools.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <BeanLog/BeanFrame.hpp>
+
+/* A time given on the command line, in both zones as plain lines are in local time and JSON ones are in UTC. */
+struct BeanTimeBound
+{
+    int64_t utc;
+    int64_t local;
+
+    /* Times are local unless they end with `Z`, as in the log lines themselves. */
+    static bool Parse(const wchar_t* arg, BeanTimeBound& bound);
+
+    /* True once `time`, read from a line with `BeanLines::GetTime`, is at or past this bound. */
+    bool IsReached(int64_t time, bool isUtc) const noexcept
+    {
+        return time >= (isUtc ? utc : local);
+    }
+};
+
+class BeanLines
+{
+public:
+    /*
+        Calls `fn(text)` for every run of log text in [`begin`, `end`), that's the payload of each frame
+        if the log is framed and the bytes themselves otherwise. Damaged frames are skipped.
+    */
+    template <typename FN>
+    static void ForEachChunk(const char* data, size_t begin, size_t end, FN&& fn)
+    {
+        const uint32_t signature = BeanFrameHeader::Signature;
+        if (end - begin < sizeof(signature) || memcmp(data + begin, &signature, sizeof(signature)))
+        {
+            fn(std::string_view(data + begin, end - begin));
+            return;
+        }
+
+        size_t offset = begin;
+        while (offset < end)
+        {
+            BeanFrameHeader header;
+            if (const size_t frame = BeanFrame::Check(data + offset, end - offset, header))
+            {
+                fn(std::string_view(data + offset + sizeof(header), header.length));
+                offset += frame;
+            }
+            else
+            {
+                offset = BeanFrame::Find(data, end, offset + 1);
+            }
+        }
+    }
+
+    /* Calls `fn(line)` for every line in `text`, without its line break. */
+    template <typename FN>
+    static void ForEachLine(std::string_view text, FN&& fn)
+    {
+        while (!text.empty())
+        {
+            const char* newline = static_cast<const char*>(memchr(text.data(), '\n', text.size()));
+            const size_t length = newline ? newline - text.data() : text.size();
+
+            std::string_view line = text.substr(0, length);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.remove_suffix(1);
+            }
+            fn(line);
+
+            text.remove_prefix(newline ? length + 1 : length);
+        }
+    }
+
+    /*
+        Reads the timestamp of a line the way BeanLog writes it, plain lines carry the local time
+        (`[APP] [2023-06-01 18:42:07.1234567] ...`) and JSON ones UTC. Continuation lines have none.
+    */
+    static bool GetTime(std::string_view line, int64_t& time, bool& isUtc) noexcept
+    {
+        if (line.starts_with('{'))
+        {
+            const size_t at = line.find("\"time\":\"");
+            isUtc = true;
+            return at != std::string_view::npos && ParseTime(line.substr(at + 8), time);
+        }
+
+        if (line.starts_with('['))
+        {
+            const size_t at = line.find("] [");
+            isUtc = false;
+            return at != std::string_view::npos && ParseTime(line.substr(at + 3), time);
+        }
+        return false;
+    }
+
+    /* Level a line was written at (`TRACE`, `INFO`, `WARN` or `FAIL`), empty for continuation lines. */
+    static std::string_view GetLevel(std::string_view line) noexcept
+    {
+        if (line.starts_with('{'))
+        {
+            const size_t at = line.find("\"level\":\"");
+            const size_t end = at == std::string_view::npos ? at : line.find('"', at + 9);
+            return end == std::string_view::npos ? std::string_view() : line.substr(at + 9, end - at - 9);
+        }
+
+        // `[APP] [time] [LEVEL]`, the level is the third bracket
+        if (line.starts_with('['))
+        {
+            const size_t time = line.find("] [");
+            const size_t at = time == std::string_view::npos ? time : line.find("] [", time + 3);
+            const size_t end = at == std::string_view::npos ? at : line.find(']', at + 3);
+            return end == std::string_view::npos ? std::string_view() : line.substr(at + 3, end - at - 3);
+        }
+        return {};
+    }
+
+    /* Category a line was written to, empty for uncategorized messages and continuation lines. */
+    static std::string_view GetCategory(std::string_view line) noexcept
+    {
+        if (line.starts_with('{'))
+        {
+            const size_t at = line.find("\"category\":\"");
+            const size_t end = at == std::string_view::npos ? at : line.find('"', at + 12);
+            return end == std::string_view::npos ? std::string_view() : line.substr(at + 12, end - at - 12);
+        }
+
+        // `[APP] [time] [LEVEL] [category]:`, uncategorized messages go straight to the `:`
+        const std::string_view level = GetLevel(line);
+        if (level.empty() || !line.substr(level.data() + level.size() - line.data()).starts_with("] ["))
+        {
+            return {};
+        }
+        const size_t at = level.data() + level.size() - line.data() + 3;
+        const size_t end = line.find("]:", at);
+        return end == std::string_view::npos ? std::string_view() : line.substr(at, end - at);
+    }
+
+    /*
+        Parses `YYYY-MM-DD HH:MM:SS[.fraction]`, a `T` between the date and the time works just as well.
+        Returns nanoseconds since the epoch of whatever zone the text is in.
+    */
+    static bool ParseTime(std::string_view text, int64_t& time) noexcept
+    {
+        int value[6]{};
+        static constexpr size_t Offsets[6] = {0, 5, 8, 11, 14, 17};
+        static constexpr size_t Widths[6] = {4, 2, 2, 2, 2, 2};
+
+        if (text.size() < 19 || text[4] != '-' || text[7] != '-' || (text[10] != ' ' && text[10] != 'T') || text[13] != ':' || text[16] != ':')
+        {
+            return false;
+        }
+
+        for (size_t field = 0; field < 6; ++field)
+        {
+            for (size_t i = 0; i < Widths[field]; ++i)
+            {
+                const char c = text[Offsets[field] + i];
+                if (c < '0' || c > '9')
+                {
+                    return false;
+                }
+                value[field] = value[field] * 10 + (c - '0');
+            }
+        }
+
+        const std::chrono::year_month_day date{std::chrono::year(value[0]), std::chrono::month(value[1]), std::chrono::day(value[2])};
+        if (!date.ok() || value[3] > 23 || value[4] > 59 || value[5] > 60)
+        {
+            return false;
+        }
+
+        // Fractions are as precise as the clock that wrote them, only the first nine digits count
+        int64_t fraction = 0;
+        size_t digits = 0;
+        if (text.size() > 19 && text[19] == '.')
+        {
+            for (size_t i = 20; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i)
+            {
+                if (digits < 9)
+                {
+                    fraction = fraction * 10 + (text[i] - '0');
+                    ++digits;
+                }
+            }
+        }
+        for (; digits < 9; ++digits)
+        {
+            fraction *= 10;
+        }
+
+        const auto seconds = std::chrono::sys_days(date).time_since_epoch() + std::chrono::hours(value[3]) + std::chrono::minutes(value[4]) + std::chrono::seconds(value[5]);
+        time = std::chrono::duration_cast<std::chrono::nanoseconds>(seconds).count() + fraction;
+        return true;
+    }
+};
+
+inline bool BeanTimeBound::Parse(const wchar_t* arg, BeanTimeBound& bound)
+{
+    std::string text;
+    for (; *arg; ++arg)
+    {
+        text += *arg < 0x80 ? static_cast<char>(*arg) : '?';
+    }
+
+    const bool isUtc = !text.empty() && text.back() == 'Z';
+    int64_t time = 0;
+    if (!BeanLines::ParseTime(isUtc ? std::string_view(text).substr(0, text.size() - 1) : text, time))
+    {
+        return false;
+    }
+
+    const std::chrono::time_zone* zone = std::chrono::current_zone();
+    if (isUtc)
+    {
+        bound.utc = time;
+        bound.local = zone->to_local(std::chrono::sys_time<std::chrono::nanoseconds>(std::chrono::nanoseconds(time))).time_since_epoch().count();
+    }
+    else
+    {
+        bound.local = time;
+        bound.utc = zone->to_sys(std::chrono::local_time<std::chrono::nanoseconds>(std::chrono::nanoseconds(time)), std::chrono::choose::earliest).time_since_epoch().count();
+    }
+    return true;
+}
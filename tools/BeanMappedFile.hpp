@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    BeanMappedFile maps a whole file into memory for the tools that read BeanLog's output.
+ */
+
+#pragma once
+
+#include <Windows.h>
+
+#include <cstddef>
+
+/* A read-only view of a whole file, the OS pages it in as it's read. Files still being written can be mapped too. */
+class BeanMappedFile
+{
+public:
+    explicit BeanMappedFile(const wchar_t* path, DWORD flags = FILE_FLAG_SEQUENTIAL_SCAN)
+    {
+        _file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, flags, nullptr);
+        if (_file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(_file, &size) || !size.QuadPart)
+        {
+            return;
+        }
+
+        _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!_mapping)
+        {
+            return;
+        }
+
+        _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (_data)
+        {
+            _size = static_cast<size_t>(size.QuadPart);
+        }
+    }
+
+    ~BeanMappedFile()
+    {
+        if (_data)
+        {
+            UnmapViewOfFile(_data);
+        }
+        if (_mapping)
+        {
+            CloseHandle(_mapping);
+        }
+        if (_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(_file);
+        }
+    }
+
+    /* An empty file is open but has no data. */
+    bool IsOpen(void) const noexcept
+    {
+        return _file != INVALID_HANDLE_VALUE;
+    }
+
+    const char* GetData(void) const noexcept
+    {
+        return _data;
+    }
+
+    size_t GetSize(void) const noexcept
+    {
+        return _size;
+    }
+
+    BeanMappedFile(const BeanMappedFile&) = delete;
+    BeanMappedFile(BeanMappedFile&&) = delete;
+    BeanMappedFile& operator=(const BeanMappedFile&) = delete;
+    BeanMappedFile& operator=(BeanMappedFile&&) = delete;
+
+private:
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = nullptr;
+    const char* _data = nullptr;
+    size_t _size = 0;
+};
@@ -0,0 +1,525 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-collect formats what applications hand over through `bean_set_sharedring` and writes it to a log file,
+    merging the rings of several applications by timestamp.
+ */
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <format>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <BeanLog/BeanClock.hpp>
+#include <BeanLog/BeanFrame.hpp>
+#include <BeanLog/BeanLine.hpp>
+#include <BeanLog/BeanShared.hpp>
+
+/* Writes records the way BeanLog itself would have, minus the colors. */
+class Writer
+{
+public:
+    Writer(HANDLE file, bool isJson, bool isFramed) : _file(file), _isJson(isJson), _isFramed(isFramed)
+    {
+    }
+
+    /* A `source` field naming the ring follows the record's own, unless `source` is empty. */
+    void Append(const BeanSharedRecord& record, std::wstring_view source)
+    {
+        record.GetFields(_fields);
+        if (!source.empty())
+        {
+            _fields.push_back(kv("source", source));
+        }
+        _Append(record.GetCategory(), record.level, record.time, record.syserr, record.GetText(), _fields);
+    }
+
+    /* Notes, like dropped messages, are written as BeanLog's own warnings. */
+    void AppendNote(std::wstring_view message)
+    {
+        const int64_t time = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now()).time_since_epoch().count();
+        _Append(L"default", BeanLogLevel::warn, time, 0, message, {});
+    }
+
+    size_t GetSize(void) const noexcept
+    {
+        return _output.size();
+    }
+
+    /* Converts what was appended to UTF-8 and writes it with a single call, in a frame if asked to. */
+    void Flush(void)
+    {
+        if (_output.empty())
+        {
+            return;
+        }
+
+        _outputUtf8.resize(WideCharToMultiByte(CP_UTF8, 0, _output.data(), static_cast<int>(_output.size()), nullptr, 0, nullptr, nullptr));
+        WideCharToMultiByte(CP_UTF8, 0, _output.data(), static_cast<int>(_output.size()), _outputUtf8.data(), static_cast<int>(_outputUtf8.size()), nullptr, nullptr);
+        std::string_view block = _outputUtf8;
+        if (_isFramed)
+        {
+            _frame.clear();
+            BeanFrame::Append(_frame, _frameSequence++, _outputUtf8);
+            block = _frame;
+        }
+
+        DWORD written = 0;
+        WriteFile(_file, block.data(), static_cast<DWORD>(block.size()), &written, nullptr);
+        _output.clear();
+    }
+
+private:
+    void _Append(std::wstring_view category, uint8_t level, int64_t time, DWORD syserr, std::wstring_view message, std::span<const BeanField> fields)
+    {
+        const BeanLogLevel lvl = static_cast<BeanLogLevel>(level);
+        const BeanLine::SysTime sys{std::chrono::nanoseconds(time)};
+        if (_isJson)
+        {
+            BeanLine::AppendJson(_output, sys, lvl, category, syserr, message, {}, fields);
+        }
+        else
+        {
+            const auto local = _zone.ToLocal(std::chrono::time_point_cast<std::chrono::system_clock::duration>(sys));
+            BeanLine::AppendPlain(_output, false, local, lvl, category == L"default" ? std::wstring_view() : category, syserr, message, {}, fields);
+        }
+    }
+
+private:
+    HANDLE _file;
+    bool _isJson;
+    bool _isFramed;
+    std::wstring _output;
+    std::string _outputUtf8;
+    std::string _frame;
+    uint64_t _frameSequence = 0;
+    std::vector<BeanField> _fields;
+    BeanTimeZone _zone;
+};
+
+/*
+    A ring named on the command line, attached once its application has created it and detached once it's gone.
+    An application started again under the same name is attached again.
+*/
+class Ring
+{
+public:
+    explicit Ring(const wchar_t* name) : _name(name)
+    {
+    }
+
+    ~Ring()
+    {
+        Detach();
+    }
+
+    const wchar_t* GetName(void) const noexcept
+    {
+        return _name;
+    }
+
+    bool IsAttached(void) const noexcept
+    {
+        return _header != nullptr;
+    }
+
+    /* Tries to attach to the ring, at most every `_attachPeriod`, it may not have been created yet. */
+    bool Attach(void)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now < _nextAttach)
+        {
+            return false;
+        }
+        _nextAttach = now + _attachPeriod;
+
+        _mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, _name);
+        if (!_mapping)
+        {
+            _unsignedSince = {};
+            if (!_isWaiting)
+            {
+                fwprintf(stderr, L"beanlog-collect: waiting for %ls.\n", _name);
+                _isWaiting = true;
+            }
+            return false;
+        }
+
+        _header = static_cast<BeanSharedHeader*>(MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        if (!_header)
+        {
+            fwprintf(stderr, L"beanlog-collect: can't map %ls (error %lu).\n", _name, GetLastError());
+            Detach();
+            return false;
+        }
+
+        // The application sets the header up right after creating the mapping, it's looked at again on the next
+        // attempt, the other rings shouldn't wait. A mapping that never gets one isn't BeanLog's
+        if (_header->signature.load(std::memory_order_acquire) != BeanSharedHeader::Signature)
+        {
+            if (_unsignedSince == std::chrono::steady_clock::time_point{})
+            {
+                _unsignedSince = now;
+            }
+            else if (now - _unsignedSince >= _signatureTimeout && !_isForeign)
+            {
+                fwprintf(stderr, L"beanlog-collect: %ls isn't a BeanLog ring.\n", _name);
+                _isForeign = true;
+            }
+            Detach();
+            return false;
+        }
+        _unsignedSince = {};
+        _isForeign = false;
+
+        // Once the application is gone, whatever it managed to publish is still here
+        _process = OpenProcess(SYNCHRONIZE, FALSE, _header->pid);
+        const bool isGone = !_process || WaitForSingleObject(_process, 0) == WAIT_OBJECT_0;
+
+        // Still the ring that was just collected, only a new one is worth attaching to
+        if (_header->pid == _finishedPid && (_header->isClosed.load(std::memory_order_acquire) || isGone))
+        {
+            Detach();
+            return false;
+        }
+
+        // The application waits for room in the ring rather than drop messages while there's a collector
+        _header->collector.store(GetCurrentProcessId(), std::memory_order_relaxed);
+
+        _ring = reinterpret_cast<const char*>(_header + 1);
+        _capacity = _header->capacity;
+        _read = _tail = _header->tail.load(std::memory_order_relaxed);
+        _dropped = 0;
+        _key = INT64_MIN;
+        _isDone = _isClosed = _isDamaged = false;
+        return true;
+    }
+
+    /* Detaches from a ring that's been collected in full, see `HasFinished`. */
+    void Finish(void)
+    {
+        _finishedPid = _header->pid;
+        _hasFinished = true;
+        Detach();
+    }
+
+    /* Hands the ring back, its application is free to create a new one under the same name. */
+    void Detach(void)
+    {
+        if (_header)
+        {
+            // Only a ring this collector claimed is handed back, the mapping may not even be BeanLog's
+            if (_ring)
+            {
+                _header->collector.store(0, std::memory_order_relaxed);
+                _ring = nullptr;
+            }
+            UnmapViewOfFile(_header);
+            _header = nullptr;
+        }
+
+        if (_process)
+        {
+            CloseHandle(_process);
+            _process = nullptr;
+        }
+
+        if (_mapping)
+        {
+            CloseHandle(_mapping);
+            _mapping = nullptr;
+        }
+    }
+
+    /*
+        Calls `fn(record, key, end)` for every record published since the last call. Keys are the records' times,
+        except they never go backwards, so that merging by key keeps the ring's own order. Returns how many there were.
+    */
+    template <typename FN>
+    size_t Read(FN&& fn)
+    {
+        // Checked ahead of the head, so that nothing published before the application went away is missed
+        _isClosed = _header->isClosed.load(std::memory_order_acquire);
+        _isDone = _isDone || _isClosed || !_process || WaitForSingleObject(_process, 0) == WAIT_OBJECT_0;
+        const uint64_t head = _header->head.load(std::memory_order_acquire);
+
+        size_t count = 0;
+        while (_read != head && !_isDamaged)
+        {
+            const size_t offset = static_cast<size_t>(_read & (_capacity - 1));
+            const size_t left = static_cast<size_t>(_capacity - offset);
+            if (left < sizeof(BeanSharedRecord))
+            {
+                _read += left;
+                continue;
+            }
+
+            // Nothing past the header is read until its lengths are known to stay within the record
+            const BeanSharedRecord& record = *reinterpret_cast<const BeanSharedRecord*>(_ring + offset);
+            if (record.size < sizeof(BeanSharedRecord) || record.size > left || record.size % 8 || (!record.isPadding && !record.IsIntact()))
+            {
+                fwprintf(stderr, L"beanlog-collect: %ls is damaged at %llu.\n", _name, static_cast<unsigned long long>(_read));
+                _isDamaged = _isDone = true;
+                break;
+            }
+
+            _read += record.size;
+            if (!record.isPadding)
+            {
+                _key = std::max(_key, record.time);
+                fn(record, _key, _read);
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    /* Messages the application dropped since the last call. */
+    uint64_t TakeDropped(void) noexcept
+    {
+        const uint64_t total = _header->dropped.load(std::memory_order_relaxed);
+        return total - std::exchange(_dropped, total);
+    }
+
+    /* Hands the space up to `end` back to the application, the records there have been written. */
+    void Release(uint64_t end) noexcept
+    {
+        _tail = end;
+    }
+
+    /* Publishes what `Release` handed back, and whatever padding follows it if nothing else is waiting. */
+    void Publish(bool isPending) noexcept
+    {
+        if (!isPending)
+        {
+            _tail = _read;
+        }
+        _header->tail.store(_tail, std::memory_order_release);
+    }
+
+    /* True once the application is gone and everything it published has been read. */
+    bool IsDone(void) const noexcept
+    {
+        return _isDone;
+    }
+
+    /* True once the ring has been collected in full at least once, it may have been attached again since. */
+    bool HasFinished(void) const noexcept
+    {
+        return _hasFinished;
+    }
+
+    /* The application went away without closing the ring, it crashed or was killed. */
+    bool IsAbandoned(void) const noexcept
+    {
+        return _isDone && !_isClosed;
+    }
+
+    Ring(const Ring&) = delete;
+    Ring(Ring&&) = delete;
+    Ring& operator=(const Ring&) = delete;
+    Ring& operator=(Ring&&) = delete;
+
+private:
+    static constexpr std::chrono::milliseconds _attachPeriod{100};
+    static constexpr std::chrono::seconds _signatureTimeout{1};
+
+    const wchar_t* _name;
+    HANDLE _mapping = nullptr;
+    HANDLE _process = nullptr;
+    BeanSharedHeader* _header = nullptr;
+    const char* _ring = nullptr;
+    uint64_t _capacity = 0;
+    uint64_t _read = 0;
+    uint64_t _tail = 0;
+    uint64_t _dropped = 0;
+    int64_t _key = INT64_MIN;
+    bool _isDone = false;
+    bool _isClosed = false;
+    bool _isDamaged = false;
+    bool _isWaiting = false;
+    bool _isForeign = false;
+    bool _hasFinished = false;
+    uint32_t _finishedPid = 0;
+    std::chrono::steady_clock::time_point _nextAttach{};
+    std::chrono::steady_clock::time_point _unsignedSince{};
+};
+
+/* A record read from a ring and not written yet, it stays where it is until then. */
+struct Pending
+{
+    const BeanSharedRecord* record;
+    Ring* ring;
+    int64_t key;
+    uint64_t end;
+};
+
+int wmain(int argc, wchar_t** argv)
+{
+    bool isJson = false;
+    bool isFramed = false;
+    std::chrono::milliseconds window{50};
+    int arg = 1;
+    for (; arg < argc && std::wstring_view(argv[arg]).starts_with(L"--"); ++arg)
+    {
+        const std::wstring_view option = argv[arg];
+        isJson |= option == L"--json";
+        isFramed |= option == L"--framed";
+        if (option == L"--window" && arg + 1 < argc)
+        {
+            window = std::chrono::milliseconds(_wtoi(argv[++arg]));
+        }
+    }
+
+    if (argc - arg < 2)
+    {
+        fwprintf(stderr, L"usage: beanlog-collect [--json] [--framed] [--window MILLISECONDS] <ring name>... <log file>\n"
+                         L"       appends what the applications name <ring name> in bean_set_sharedring to <log file>,\n"
+                         L"       in timestamp order, until all of them are gone\n");
+        return EXIT_FAILURE;
+    }
+    const wchar_t* path = argv[argc - 1];
+
+    HANDLE file = CreateFileW(path, FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fwprintf(stderr, L"beanlog-collect: can't open %ls (error %lu).\n", path, GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::unique_ptr<Ring>> rings;
+    for (; arg < argc - 1; ++arg)
+    {
+        rings.push_back(std::make_unique<Ring>(argv[arg]));
+    }
+
+    // A single ring is written just like its application would have, several get a `source` field
+    const bool isMerged = rings.size() > 1;
+    Writer writer(file, isJson, isFramed);
+    std::vector<Pending> pending;
+
+    // The newest key read by each round, the horizon catches up with it once it's `window` old. Going by when keys
+    // were read rather than by the clock, records are never held back for longer than that, whatever either clock does
+    std::deque<std::pair<std::chrono::steady_clock::time_point, int64_t>> rounds;
+    int64_t newest = INT64_MIN;
+    int64_t horizon = INT64_MIN;
+
+    // Until every ring has come and gone, and none came back
+    const auto isOver = [&]
+    {
+        return std::all_of(rings.begin(), rings.end(), [](const std::unique_ptr<Ring>& ring) { return ring->HasFinished() && !ring->IsAttached(); });
+    };
+
+    while (!isOver())
+    {
+        size_t read = 0;
+        bool isLive = false;
+        for (const std::unique_ptr<Ring>& ring : rings)
+        {
+            if (!ring->IsAttached() && !ring->Attach())
+            {
+                continue;
+            }
+
+            read += ring->Read([&](const BeanSharedRecord& record, int64_t key, uint64_t end)
+            {
+                pending.push_back({&record, ring.get(), key, end});
+                newest = std::max(newest, key);
+            });
+            isLive |= !ring->IsDone();
+
+            if (const uint64_t dropped = ring->TakeDropped())
+            {
+                writer.AppendNote(std::format(L"[BeanLog] {} messages were dropped, the shared ring {} was full.", dropped, ring->GetName()));
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (read)
+        {
+            rounds.emplace_back(now, newest);
+        }
+        while (!rounds.empty() && now - rounds.front().first >= window)
+        {
+            horizon = rounds.front().second;
+            rounds.pop_front();
+        }
+
+        // Records newer than the horizon wait, another application may still be about to publish something older.
+        // Keys never go backwards within a ring, so each ring's records come out in their own order
+        std::stable_sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b)
+        {
+            return a.key < b.key;
+        });
+
+        size_t count = pending.size();
+        if (isMerged && isLive)
+        {
+            count = std::partition_point(pending.begin(), pending.end(), [horizon](const Pending& entry)
+            {
+                return entry.key <= horizon;
+            }) - pending.begin();
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            writer.Append(*pending[i].record, isMerged ? pending[i].ring->GetName() : L"");
+            pending[i].ring->Release(pending[i].end);
+
+            // Hand the space back every now and then, a large backlog shouldn't keep the applications waiting
+            if (writer.GetSize() >= 256 * 1024)
+            {
+                writer.Flush();
+                for (const std::unique_ptr<Ring>& ring : rings)
+                {
+                    if (ring->IsAttached())
+                    {
+                        ring->Publish(true);
+                    }
+                }
+            }
+        }
+        pending.erase(pending.begin(), pending.begin() + count);
+        writer.Flush();
+
+        for (const std::unique_ptr<Ring>& ring : rings)
+        {
+            if (!ring->IsAttached())
+            {
+                continue;
+            }
+
+            const bool isPending = std::any_of(pending.begin(), pending.end(), [&](const Pending& entry) { return entry.ring == ring.get(); });
+            ring->Publish(isPending);
+            if (ring->IsDone() && !isPending)
+            {
+                if (ring->IsAbandoned())
+                {
+                    fwprintf(stderr, L"beanlog-collect: the application exited without closing %ls.\n", ring->GetName());
+                }
+                ring->Finish();
+            }
+        }
+
+        if (!read)
+        {
+            Sleep(2);
+        }
+    }
+
+    CloseHandle(file);
+    return EXIT_SUCCESS;
+}
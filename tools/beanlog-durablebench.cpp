@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-durablebench measures how many failures per second make it to disk with 1, 8 and 64 threads failing at
+    once, committed in groups by `bean_set_durable` and flushed one by one by `bean_set_prioritysync`.
+    Logging is compiled out of release builds, this one has to be built with `_DEBUG`.
+ */
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <thread>
+#include <vector>
+
+#include <BeanLog/BeanLog.hpp>
+
+/* Every thread is held back until all of them are running, returns how long it took them to log `messages` failures in all. */
+static std::chrono::steady_clock::duration Run(size_t threads, size_t messages)
+{
+    std::atomic<bool> isStarted = false;
+    std::vector<std::thread> workers;
+    for (size_t thread = 0; thread < threads; ++thread)
+    {
+        // The remainder goes to the first few threads
+        const size_t count = messages / threads + (thread < messages % threads);
+        workers.emplace_back([&isStarted, thread, count]
+        {
+            while (!isStarted.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            for (size_t seq = 0; seq < count; ++seq)
+            {
+                bean_fail(L"durable", kv("thread", thread), kv("seq", seq));
+            }
+        });
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    isStarted.store(true, std::memory_order_release);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    return std::chrono::steady_clock::now() - begin;
+}
+
+static void Report(const wchar_t* mode, size_t threads, size_t messages, std::chrono::steady_clock::duration elapsed)
+{
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    fwprintf(stderr, L"%-14ls %2zu threads: %10.0f failures/s, %8.1fus each\n", mode, threads, messages / seconds, seconds * 1e6 / messages * threads);
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    if (argc > 3 || (argc >= 2 && !iswdigit(argv[1][0])) || (argc == 3 && !iswdigit(argv[2][0])))
+    {
+        fwprintf(stderr, L"usage: beanlog-durablebench [messages] [commit latency] > <log file>\n"
+                         L"       each run logs 6400 failures in all by default, split between its threads, groups wait\n"
+                         L"       up to 1000us for others to join\n");
+        return EXIT_FAILURE;
+    }
+
+#ifdef _DEBUG
+    const size_t messages = argc >= 2 ? wcstoull(argv[1], nullptr, 10) : 6400;
+    const unsigned long long latency = argc >= 3 ? wcstoull(argv[2], nullptr, 10) : 1000;
+
+    // Consoles have nothing to flush, there'd be nothing to measure
+    DWORD mode = 0;
+    if (GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &mode))
+    {
+        fwprintf(stderr, L"beanlog-durablebench: redirect the output to a file.\n");
+        return EXIT_FAILURE;
+    }
+
+    bean_set_outputformat(json);
+    bean_set_async(true);
+    bean_set_commitlatency(latency);
+
+    for (const size_t threads : {1, 8, 64})
+    {
+        bean_set_prioritysync(false);
+        bean_set_durable(true);
+        Report(L"group commit", threads, messages, Run(threads, messages));
+
+        bean_set_durable(false);
+        bean_set_prioritysync(true);
+        Report(L"flush each", threads, messages, Run(threads, messages));
+    }
+    return EXIT_SUCCESS;
+#else
+    fwprintf(stderr, L"beanlog-durablebench: logging is compiled out of release builds, build with _DEBUG.\n");
+    return EXIT_FAILURE;
+#endif
+}
@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-grep prints the lines that hold every given word, skipping the segments whose Bloom filter rules them out.
+ */
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <BeanLog/BeanBloom.hpp>
+
+#include "BeanLines.hpp"
+#include "BeanMappedFile.hpp"
+
+/* What the search looks for, words match whole and regardless of case. */
+struct Query
+{
+    std::vector<uint64_t> words;
+    std::string level;
+};
+
+/* Totals over every file, reported once the search is done. */
+struct Stats
+{
+    uint64_t segments = 0;
+    uint64_t skipped = 0;
+    uint64_t bytes = 0;
+};
+
+static bool IsMatch(const Query& query, std::string_view line, std::vector<uint64_t>& words)
+{
+    if (!query.level.empty())
+    {
+        const std::string_view level = BeanLines::GetLevel(line);
+        if (level.size() != query.level.size() || _strnicmp(level.data(), query.level.data(), level.size()))
+        {
+            return false;
+        }
+    }
+
+    words.clear();
+    BeanBloom::ForEachWord(line, [&](uint64_t hash) { words.push_back(hash); });
+    return std::all_of(query.words.begin(), query.words.end(), [&](uint64_t hash) { return std::find(words.begin(), words.end(), hash) != words.end(); });
+}
+
+static void Search(const wchar_t* path, const Query& query, bool isNamed, Stats& stats, std::string& buffer)
+{
+    const BeanMappedFile log(path);
+    if (!log.IsOpen())
+    {
+        fwprintf(stderr, L"beanlog-grep: can't open %ls (error %lu).\n", path, GetLastError());
+        return;
+    }
+
+    std::string name;
+    if (isNamed)
+    {
+        name.resize(WideCharToMultiByte(CP_UTF8, 0, path, -1, nullptr, 0, nullptr, nullptr));
+        WideCharToMultiByte(CP_UTF8, 0, path, -1, name.data(), static_cast<int>(name.size()), nullptr, nullptr);
+        name.back() = ':';
+    }
+
+    std::vector<uint64_t> words;
+    const auto scan = [&](size_t begin, size_t end)
+    {
+        stats.bytes += end - begin;
+        BeanLines::ForEachChunk(log.GetData(), begin, end, [&](std::string_view chunk)
+        {
+            BeanLines::ForEachLine(chunk, [&](std::string_view line)
+            {
+                if (!IsMatch(query, line, words))
+                {
+                    return;
+                }
+
+                buffer += name;
+                buffer += line;
+                buffer += '\n';
+                if (buffer.size() >= 64 * 1024)
+                {
+                    DWORD written = 0;
+                    WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+                    buffer.clear();
+                }
+            });
+        });
+    };
+
+    // Without filters the whole log is read, the same goes for whatever the filters don't cover
+    const std::wstring filterPath = std::wstring(path) + L".bloom";
+    const BeanMappedFile filters(filterPath.c_str());
+    BeanBloomHeader header{};
+    if (filters.GetSize() >= sizeof(header))
+    {
+        memcpy(&header, filters.GetData(), sizeof(header));
+    }
+    if (header.signature != BeanBloomHeader::Signature || header.hashes != BeanBloom::Hashes || !header.filterBytes)
+    {
+        scan(0, log.GetSize());
+        return;
+    }
+
+    const size_t size = log.GetSize();
+    const size_t record = sizeof(BeanBloomSegment) + header.filterBytes;
+    size_t covered = 0;
+    for (size_t at = sizeof(header); at + record <= filters.GetSize(); at += record)
+    {
+        BeanBloomSegment segment;
+        memcpy(&segment, filters.GetData() + at, sizeof(segment));
+        if (segment.begin < covered || segment.end > size || segment.begin >= segment.end)
+        {
+            break;
+        }
+
+        if (segment.begin > covered)
+        {
+            scan(covered, static_cast<size_t>(segment.begin));
+        }
+        covered = static_cast<size_t>(segment.end);
+
+        ++stats.segments;
+        const uint8_t* bits = reinterpret_cast<const uint8_t*>(filters.GetData() + at + sizeof(segment));
+        if (!std::all_of(query.words.begin(), query.words.end(), [&](uint64_t hash) { return BeanBloom::MayContain(bits, header.filterBytes, hash); }))
+        {
+            ++stats.skipped;
+            continue;
+        }
+        scan(static_cast<size_t>(segment.begin), covered);
+    }
+
+    if (covered < size)
+    {
+        scan(covered, size);
+    }
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    Query query;
+    int arg = 1;
+    if (arg + 1 < argc && !wcscmp(argv[arg], L"--level"))
+    {
+        for (const wchar_t* c = argv[arg + 1]; *c; ++c)
+        {
+            query.level += static_cast<char>(*c);
+        }
+        arg += 2;
+    }
+
+    if (argc - arg < 2)
+    {
+        fwprintf(stderr, L"usage: beanlog-grep [--level LEVEL] <words> <log file>...\n"
+                         L"       prints the lines holding every word in <words>, words are runs of ASCII letters, digits and _\n");
+        return EXIT_FAILURE;
+    }
+
+    // The level is a word of the line as well, segments without it can be skipped just the same
+    BeanBloom::ForEachWord(std::wstring_view(argv[arg]), [&](uint64_t hash) { query.words.push_back(hash); });
+    BeanBloom::ForEachWord(std::string_view(query.level), [&](uint64_t hash) { query.words.push_back(hash); });
+    if (query.words.empty())
+    {
+        fwprintf(stderr, L"beanlog-grep: nothing to look for.\n");
+        return EXIT_FAILURE;
+    }
+
+    Stats stats;
+    std::string buffer;
+    for (int file = arg + 1; file < argc; ++file)
+    {
+        Search(argv[file], query, argc - arg > 2, stats, buffer);
+    }
+
+    DWORD written = 0;
+    WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+
+    fwprintf(stderr, L"beanlog-grep: skipped %llu of %llu segments, read %llu bytes.\n", stats.skipped, stats.segments, stats.bytes);
+    return EXIT_SUCCESS;
+}
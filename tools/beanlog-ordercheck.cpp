@@ -0,0 +1,186 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-ordercheck logs from many threads at once in async mode and checks the result: every thread's records
+    have to come out complete and in the order they were logged, and all of them in timestamp order.
+    Logging is compiled out of release builds, this one has to be built with `_DEBUG`.
+ */
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <BeanLog/BeanLog.hpp>
+
+#include "BeanLines.hpp"
+#include "BeanMappedFile.hpp"
+
+/* Every thread is held back until all of them are running, so that they start out contending. */
+static int Produce(size_t threads, size_t messages)
+{
+#ifdef _DEBUG
+    bean_set_outputformat(json);
+    bean_set_async(true);
+
+    std::atomic<bool> isStarted = false;
+    std::vector<std::thread> workers;
+    for (size_t thread = 0; thread < threads; ++thread)
+    {
+        workers.emplace_back([&isStarted, thread, messages]
+        {
+            while (!isStarted.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            for (size_t seq = 0; seq < messages; ++seq)
+            {
+                bean_info(L"ordered", kv("thread", thread), kv("seq", seq));
+            }
+        });
+    }
+
+    isStarted.store(true, std::memory_order_release);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    return EXIT_SUCCESS;
+#else
+    (void)threads;
+    (void)messages;
+    fwprintf(stderr, L"beanlog-ordercheck: logging is compiled out of release builds, build with _DEBUG.\n");
+    return EXIT_FAILURE;
+#endif
+}
+
+/* What's been read of one producer thread's records. */
+struct Thread
+{
+    size_t last = 0;
+    size_t seen = 0;
+    size_t end = 0;
+};
+
+/* Reads the number that follows `"key":` in a JSON line. */
+static bool GetNumber(std::string_view line, std::string_view key, size_t& value)
+{
+    const size_t at = line.find(key);
+    if (at == std::string_view::npos)
+    {
+        return false;
+    }
+
+    const char* begin = line.data() + at + key.size();
+    return std::from_chars(begin, line.data() + line.size(), value).ec == std::errc();
+}
+
+static int Verify(const wchar_t* path)
+{
+    const BeanMappedFile log(path);
+    if (!log.IsOpen())
+    {
+        fwprintf(stderr, L"beanlog-ordercheck: can't open %ls (error %lu).\n", path, GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Thread> threads;
+    size_t records = 0;
+    size_t reordered = 0;
+    size_t missing = 0;
+    size_t inversions = 0;
+    int64_t worst = 0;
+    int64_t last = INT64_MIN;
+
+    BeanLines::ForEachChunk(log.GetData(), 0, log.GetSize(), [&](std::string_view chunk)
+    {
+        BeanLines::ForEachLine(chunk, [&](std::string_view line)
+        {
+            // BeanLog's own messages carry neither field
+            size_t thread = 0;
+            size_t seq = 0;
+            int64_t time = 0;
+            bool isUtc = false;
+            if (!GetNumber(line, "\"thread\":", thread) || !GetNumber(line, "\"seq\":", seq) || !BeanLines::GetTime(line, time, isUtc))
+            {
+                return;
+            }
+            ++records;
+
+            if (thread >= threads.size())
+            {
+                threads.resize(thread + 1);
+            }
+
+            // Each record is counted once against the one its thread wrote before, a single swap counts twice at most
+            Thread& producer = threads[thread];
+            if (producer.seen && seq <= producer.last)
+            {
+                ++reordered;
+            }
+            producer.last = seq;
+            producer.end = std::max(producer.end, seq + 1);
+            ++producer.seen;
+
+            if (time < last)
+            {
+                ++inversions;
+                worst = std::max(worst, last - time);
+            }
+            last = time;
+        });
+    });
+
+    // Records missing off the end of a thread only show against the others
+    size_t messages = 0;
+    for (const Thread& producer : threads)
+    {
+        messages = std::max(messages, producer.end);
+    }
+    for (const Thread& producer : threads)
+    {
+        missing += messages - std::min(messages, producer.seen);
+    }
+
+    wprintf(L"%zu records from %zu threads: %zu out of their thread's order, %zu missing, %zu out of timestamp order",
+            records, threads.size(), reordered, missing, inversions);
+    if (inversions)
+    {
+        wprintf(L" (by up to %lldns)", static_cast<long long>(worst));
+    }
+    wprintf(L".\n");
+
+    return records && !reordered && !missing && !inversions ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    if (argc >= 2 && argc <= 4 && !wcscmp(argv[1], L"produce"))
+    {
+        const size_t threads = argc >= 3 ? wcstoull(argv[2], nullptr, 10) : 64;
+        const size_t messages = argc >= 4 ? wcstoull(argv[3], nullptr, 10) : 10000;
+        return Produce(threads, messages);
+    }
+
+    if (argc == 3 && !wcscmp(argv[1], L"verify"))
+    {
+        return Verify(argv[2]);
+    }
+
+    fwprintf(stderr, L"usage: beanlog-ordercheck produce [threads] [messages] > <log file>\n"
+                     L"       beanlog-ordercheck verify <log file>\n"
+                     L"       threads default to 64, each of them logging 10000 messages\n");
+    return EXIT_FAILURE;
+}
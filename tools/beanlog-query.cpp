@@ -0,0 +1,350 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-query filters a log by level, time, category and text, scanning it with every core and printing in order.
+ */
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+#include <BeanLog/BeanFrame.hpp>
+#include <BeanLog/BeanIndex.hpp>
+
+#include "BeanLines.hpp"
+#include "BeanMappedFile.hpp"
+
+/* A record is a message's `[APP]` or JSON line, followed by its `[SYS]` line and whatever lines its text spans. */
+struct Filter
+{
+    std::string level;
+    std::string category;
+    std::string text;
+    BeanTimeBound from{INT64_MIN, INT64_MIN};
+    BeanTimeBound to{INT64_MAX, INT64_MAX};
+};
+
+/*
+    First occurrence of `needle` in [`begin`, `end`), `nullptr` if there's none. Blocks of 16 positions are
+    checked at once against the first and last character of the needle, only the survivors are compared in full.
+*/
+static const char* FindText(const char* begin, const char* end, std::string_view needle) noexcept
+{
+    const size_t length = needle.size();
+    if (static_cast<size_t>(end - begin) < length)
+    {
+        return nullptr;
+    }
+
+    const char* at = begin;
+#if defined(_M_X64) || defined(_M_IX86)
+    if (length >= 2)
+    {
+        const __m128i first = _mm_set1_epi8(needle.front());
+        const __m128i last = _mm_set1_epi8(needle.back());
+        for (; at + length - 1 + 16 <= end; at += 16)
+        {
+            const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+            const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at + length - 1));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+            while (mask)
+            {
+                const int i = std::countr_zero(mask);
+                if (!memcmp(at + i + 1, needle.data() + 1, length - 2))
+                {
+                    return at + i;
+                }
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+
+    // Whatever's left is too short for a whole block
+    while (static_cast<size_t>(end - at) >= length)
+    {
+        at = static_cast<const char*>(memchr(at, needle.front(), end - at - length + 1));
+        if (!at)
+        {
+            return nullptr;
+        }
+        if (!memcmp(at, needle.data(), length))
+        {
+            return at;
+        }
+        ++at;
+    }
+    return nullptr;
+}
+
+static bool IsRecordStart(std::string_view line) noexcept
+{
+    return line.starts_with("[APP]") || line.starts_with('{');
+}
+
+/* Start of the line holding `at`, lines never span chunks. */
+static const char* GetLineStart(const char* begin, const char* at) noexcept
+{
+    while (at > begin && at[-1] != '\n')
+    {
+        --at;
+    }
+    return at;
+}
+
+/* Start of the next line past `at`, `end` if there's none. */
+static const char* GetNextLine(const char* at, const char* end) noexcept
+{
+    const char* newline = static_cast<const char*>(memchr(at, '\n', end - at));
+    return newline ? newline + 1 : end;
+}
+
+static bool IsMatch(const Filter& filter, std::string_view record) noexcept
+{
+    const std::string_view head = record.substr(0, record.find('\n'));
+
+    if (!filter.level.empty())
+    {
+        const std::string_view level = BeanLines::GetLevel(head);
+        if (level.size() != filter.level.size() || _strnicmp(level.data(), filter.level.data(), level.size()))
+        {
+            return false;
+        }
+    }
+
+    if (!filter.category.empty() && BeanLines::GetCategory(head) != filter.category)
+    {
+        return false;
+    }
+
+    int64_t time = 0;
+    bool isUtc = false;
+    if (BeanLines::GetTime(head, time, isUtc) && (!filter.from.IsReached(time, isUtc) || filter.to.IsReached(time, isUtc)))
+    {
+        return false;
+    }
+    return true;
+}
+
+/* Appends the records of `chunk` that pass `filter` to `out`. */
+static void Scan(const Filter& filter, std::string_view chunk, std::string& out)
+{
+    const char* begin = chunk.data();
+    const char* end = begin + chunk.size();
+
+    // Look for the text first, it's by far the most selective filter and it can skip whole stretches at a time
+    const char* at = begin;
+    while (at < end)
+    {
+        const char* match = at;
+        if (!filter.text.empty())
+        {
+            match = FindText(at, end, filter.text);
+            if (!match)
+            {
+                return;
+            }
+        }
+
+        const char* start = GetLineStart(at, match);
+        while (start > at && !IsRecordStart(std::string_view(start, GetNextLine(start, end) - start)))
+        {
+            start = GetLineStart(at, start - 1);
+        }
+
+        const char* stop = GetNextLine(match, end);
+        while (stop < end && !IsRecordStart(std::string_view(stop, GetNextLine(stop, end) - stop)))
+        {
+            stop = GetNextLine(stop, end);
+        }
+
+        const std::string_view record(start, stop - start);
+        if (IsMatch(filter, record))
+        {
+            out += record;
+            if (!record.ends_with('\n'))
+            {
+                out += '\n';
+            }
+        }
+        at = stop;
+    }
+}
+
+/* Moves `at` forward to where a part can start: a frame in a framed log, a record otherwise. */
+static size_t AlignPart(const char* data, size_t at, size_t end, bool isFramed)
+{
+    if (isFramed)
+    {
+        BeanFrameHeader header;
+        while ((at = BeanFrame::Find(data, end, at)) < end && !BeanFrame::Check(data + at, end - at, header))
+        {
+            ++at;
+        }
+        return at;
+    }
+
+    while (at < end && !IsRecordStart(std::string_view(data + at, GetNextLine(data + at, data + end) - (data + at))))
+    {
+        at = GetNextLine(data + at, data + end) - data;
+    }
+    return at;
+}
+
+static void ToNarrow(const wchar_t* arg, std::string& out)
+{
+    out.resize(WideCharToMultiByte(CP_UTF8, 0, arg, -1, nullptr, 0, nullptr, nullptr));
+    WideCharToMultiByte(CP_UTF8, 0, arg, -1, out.data(), static_cast<int>(out.size()), nullptr, nullptr);
+    out.pop_back();
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    Filter filter;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    const wchar_t* path = nullptr;
+    bool isValid = true;
+
+    for (int arg = 1; arg < argc && isValid; ++arg)
+    {
+        const std::wstring_view option = argv[arg];
+        const wchar_t* value = arg + 1 < argc ? argv[arg + 1] : nullptr;
+        if (!option.starts_with(L"--"))
+        {
+            isValid = !path;
+            path = argv[arg];
+            continue;
+        }
+
+        if (!value)
+        {
+            isValid = false;
+            break;
+        }
+        ++arg;
+
+        if (option == L"--level")
+        {
+            ToNarrow(value, filter.level);
+        }
+        else if (option == L"--category")
+        {
+            ToNarrow(value, filter.category);
+        }
+        else if (option == L"--text")
+        {
+            ToNarrow(value, filter.text);
+        }
+        else if (option == L"--from")
+        {
+            isValid = BeanTimeBound::Parse(value, filter.from);
+        }
+        else if (option == L"--to")
+        {
+            isValid = BeanTimeBound::Parse(value, filter.to);
+        }
+        else if (option == L"--threads")
+        {
+            threads = std::max(1, _wtoi(value));
+        }
+        else
+        {
+            isValid = false;
+        }
+    }
+
+    if (!isValid || !path)
+    {
+        fwprintf(stderr, L"usage: beanlog-query <log file> [--level LEVEL] [--category NAME] [--text TEXT]\n"
+                         L"                     [--from TIME] [--to TIME] [--threads COUNT]\n"
+                         L"       times look like \"2023-06-01 18:42:07.5\", local unless they end with Z\n");
+        return EXIT_FAILURE;
+    }
+
+    const BeanMappedFile log(path);
+    if (!log.IsOpen())
+    {
+        fwprintf(stderr, L"beanlog-query: can't open %ls (error %lu).\n", path, GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    const char* data = log.GetData();
+    size_t begin = 0;
+    size_t end = log.GetSize();
+
+    // A time window narrows the scan down to what the index says covers it
+    const BeanMappedFile index((std::wstring(path) + L".idx").c_str(), FILE_FLAG_RANDOM_ACCESS);
+    BeanIndexHeader header{};
+    if (index.GetSize() >= sizeof(header))
+    {
+        memcpy(&header, index.GetData(), sizeof(header));
+    }
+    if (header.signature == BeanIndexHeader::Signature && header.entrySize == sizeof(BeanIndexEntry))
+    {
+        const std::span<const BeanIndexEntry> entries(reinterpret_cast<const BeanIndexEntry*>(index.GetData() + sizeof(header)), (index.GetSize() - sizeof(header)) / sizeof(BeanIndexEntry));
+        begin = static_cast<size_t>(std::min<uint64_t>(BeanIndex::Seek(entries, filter.from.utc), end));
+        end = static_cast<size_t>(std::max<uint64_t>(std::min<uint64_t>(BeanIndex::SeekEnd(entries, filter.to.utc, end), end), begin));
+    }
+
+    const uint32_t signature = BeanFrameHeader::Signature;
+    const bool isFramed = end - begin >= sizeof(signature) && !memcmp(data + begin, &signature, sizeof(signature));
+
+    // Parts are small enough to keep every thread busy till the end, and large enough not to be dominated by their setup
+    const size_t partSize = std::clamp<size_t>((end - begin) / (threads * 8), 1 << 20, 64 << 20);
+    std::vector<size_t> bounds{begin};
+    while (bounds.back() < end)
+    {
+        bounds.push_back(AlignPart(data, std::min(bounds.back() + partSize, end), end, isFramed));
+    }
+
+    std::vector<std::promise<std::string>> results(bounds.size() - 1);
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(threads, results.size()); ++i)
+    {
+        workers.emplace_back([&]
+        {
+            for (size_t part; (part = next.fetch_add(1, std::memory_order_relaxed)) < results.size();)
+            {
+                std::string out;
+                BeanLines::ForEachChunk(data, bounds[part], bounds[part + 1], [&](std::string_view chunk) { Scan(filter, chunk, out); });
+                results[part].set_value(std::move(out));
+            }
+        });
+    }
+
+    // Parts are printed as soon as they and every part before them are done
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    for (std::promise<std::string>& result : results)
+    {
+        const std::string out = result.get_future().get();
+        DWORD written = 0;
+        WriteFile(output, out.data(), static_cast<DWORD>(out.size()), &written, nullptr);
+    }
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    fwprintf(stderr, L"beanlog-query: read %llu of %llu bytes in %zu parts.\n", static_cast<unsigned long long>(end - begin), static_cast<unsigned long long>(log.GetSize()), results.size());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-recover extracts every intact frame from a log written with `bean_set_framing(true)`.
+ */
+
+#include <Windows.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <BeanLog/BeanFrame.hpp>
+
+#include "BeanMappedFile.hpp"
+
+int wmain(int argc, wchar_t** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fwprintf(stderr, L"usage: beanlog-recover <log file> [output file]\n");
+        return EXIT_FAILURE;
+    }
+
+    const BeanMappedFile input(argv[1]);
+    if (!input.IsOpen())
+    {
+        fwprintf(stderr, L"beanlog-recover: can't open %ls (error %lu).\n", argv[1], GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (argc == 3)
+    {
+        output = CreateFileW(argv[2], GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (output == INVALID_HANDLE_VALUE)
+        {
+            fwprintf(stderr, L"beanlog-recover: can't create %ls (error %lu).\n", argv[2], GetLastError());
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char* data = input.GetData();
+    const size_t size = input.GetSize();
+
+    uint64_t frames = 0;
+    uint64_t gaps = 0;
+    uint64_t skipped = 0;
+    uint64_t expected = 0;
+    size_t offset = 0;
+    while (offset < size)
+    {
+        BeanFrameHeader header;
+        if (const size_t frame = BeanFrame::Check(data + offset, size - offset, header))
+        {
+            // Frames missing in between were damaged beyond recognition, or the sequence restarted with a new process
+            if (frames && header.sequence != expected)
+            {
+                ++gaps;
+            }
+            expected = header.sequence + 1;
+
+            DWORD written = 0;
+            WriteFile(output, data + offset + sizeof(header), header.length, &written, nullptr);
+            ++frames;
+            offset += frame;
+            continue;
+        }
+
+        const size_t next = BeanFrame::Find(data, size, offset + 1);
+        skipped += next - offset;
+        offset = next;
+    }
+
+    if (argc == 3)
+    {
+        CloseHandle(output);
+    }
+
+    fwprintf(stderr, L"beanlog-recover: %llu frames recovered, %llu bytes skipped, %llu gaps in the sequence.\n", frames, skipped, gaps);
+    return skipped ? 2 : EXIT_SUCCESS;
+}
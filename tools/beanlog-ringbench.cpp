@@ -0,0 +1,242 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-ringbench measures how many messages per second several producer processes get to disk, once through
+    shared rings merged by beanlog-collect and once with every process writing its own file, for comparison.
+    Logging is compiled out of release builds, this one has to be built with `_DEBUG`. beanlog-collect has to be
+    found next to it.
+ */
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <format>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <BeanLog/BeanLog.hpp>
+#include <BeanLog/BeanShared.hpp>
+
+#include "BeanLines.hpp"
+#include "BeanMappedFile.hpp"
+
+/* Waits for beanlog-collect to attach to the ring, messages logged before it does would only be dropped. */
+static bool WaitForCollector(const wchar_t* ring)
+{
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, ring);
+    if (!mapping)
+    {
+        return false;
+    }
+
+    bool isAttached = false;
+    if (const auto* header = static_cast<const BeanSharedHeader*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(BeanSharedHeader))))
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!(isAttached = header->collector.load(std::memory_order_acquire)) && std::chrono::steady_clock::now() < deadline)
+        {
+            Sleep(1);
+        }
+        UnmapViewOfFile(header);
+    }
+    CloseHandle(mapping);
+    return isAttached;
+}
+
+/* Logs `messages` messages to the ring named `ring`, or to stdout when that's `nullptr`. */
+static int Produce(const wchar_t* ring, size_t process, size_t messages)
+{
+#ifdef _DEBUG
+    bean_set_outputformat(json);
+    bean_set_async(true);
+
+    if (ring)
+    {
+        bean_set_sharedring(ring, 4096);
+        if (!WaitForCollector(ring))
+        {
+            fwprintf(stderr, L"beanlog-ringbench: beanlog-collect never attached to %ls.\n", ring);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (size_t seq = 0; seq < messages; ++seq)
+    {
+        bean_info(L"ring", kv("process", process), kv("seq", seq));
+    }
+    return EXIT_SUCCESS;
+#else
+    (void)ring;
+    (void)process;
+    (void)messages;
+    fwprintf(stderr, L"beanlog-ringbench: logging is compiled out of release builds, build with _DEBUG.\n");
+    return EXIT_FAILURE;
+#endif
+}
+
+/* Starts `command`, with its stdout going to `output` unless that's `nullptr`. Returns the process' handle or `nullptr`. */
+static HANDLE Launch(std::wstring command, HANDLE output)
+{
+    STARTUPINFOW startup{};
+    startup.cb = sizeof(startup);
+    if (output)
+    {
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+        startup.hStdOutput = output;
+        startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    }
+
+    PROCESS_INFORMATION process{};
+    if (!CreateProcessW(nullptr, command.data(), nullptr, nullptr, output != nullptr, 0, nullptr, nullptr, &startup, &process))
+    {
+        fwprintf(stderr, L"beanlog-ringbench: can't start %ls (error %lu).\n", command.c_str(), GetLastError());
+        return nullptr;
+    }
+
+    CloseHandle(process.hThread);
+    return process.hProcess;
+}
+
+/* Waits for every process and closes their handles, true if all of them succeeded. */
+static bool Wait(std::vector<HANDLE>& processes)
+{
+    bool isSuccess = true;
+    for (HANDLE process : processes)
+    {
+        DWORD code = EXIT_FAILURE;
+        WaitForSingleObject(process, INFINITE);
+        isSuccess &= GetExitCodeProcess(process, &code) && code == EXIT_SUCCESS;
+        CloseHandle(process);
+    }
+    processes.clear();
+    return isSuccess;
+}
+
+/* Counts the benchmark's own records, BeanLog's and the collector's notes carry no `seq` field. */
+static size_t CountRecords(const wchar_t* path)
+{
+    const BeanMappedFile log(path);
+    size_t records = 0;
+    if (log.IsOpen())
+    {
+        BeanLines::ForEachChunk(log.GetData(), 0, log.GetSize(), [&](std::string_view chunk)
+        {
+            BeanLines::ForEachLine(chunk, [&](std::string_view line)
+            {
+                records += line.find("\"seq\":") != std::string_view::npos;
+            });
+        });
+    }
+    return records;
+}
+
+static void Report(const wchar_t* mode, size_t processes, size_t records, size_t expected, std::chrono::steady_clock::duration elapsed)
+{
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    wprintf(L"%-12ls %zu processes: %zu of %zu records in %.3fs, %10.0f records/s\n", mode, processes, records, expected, seconds, records / seconds);
+}
+
+/* Both runs count from the first process started to the last one gone, start-up included. */
+static int Run(size_t processes, size_t messages)
+{
+    wchar_t self[MAX_PATH];
+    if (!GetModuleFileNameW(nullptr, self, MAX_PATH))
+    {
+        fwprintf(stderr, L"beanlog-ringbench: can't find its own path (error %lu).\n", GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    const std::wstring_view path = self;
+    const std::wstring collector = std::wstring(path.substr(0, path.find_last_of(L"\\/") + 1)) + L"beanlog-collect.exe";
+    const size_t expected = processes * messages;
+    std::vector<HANDLE> running;
+    bool isSuccess = true;
+
+    // One collector merges every ring into a single file
+    {
+        DeleteFileW(L"ringbench-shared.log");
+        std::wstring rings;
+        const auto begin = std::chrono::steady_clock::now();
+        for (size_t process = 0; process < processes; ++process)
+        {
+            const std::wstring ring = std::format(L"Local\\beanlog-ringbench-{}", process);
+            rings += std::format(L" \"{}\"", ring);
+            if (HANDLE producer = Launch(std::format(L"\"{}\" produce {} {} \"{}\"", self, process, messages, ring), nullptr))
+            {
+                running.push_back(producer);
+            }
+        }
+        if (HANDLE merger = Launch(std::format(L"\"{}\" --json{} ringbench-shared.log", collector, rings), nullptr))
+        {
+            running.push_back(merger);
+        }
+        isSuccess &= running.size() == processes + 1;
+        isSuccess &= Wait(running);
+        Report(L"shared rings", processes, CountRecords(L"ringbench-shared.log"), expected, std::chrono::steady_clock::now() - begin);
+    }
+
+    // Every process writes its own file, nothing is merged
+    {
+        SECURITY_ATTRIBUTES inherited{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+        std::vector<std::wstring> files;
+        const auto begin = std::chrono::steady_clock::now();
+        for (size_t process = 0; process < processes; ++process)
+        {
+            files.push_back(std::format(L"ringbench-{}.log", process));
+            HANDLE file = CreateFileW(files.back().c_str(), GENERIC_WRITE, FILE_SHARE_READ, &inherited, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                fwprintf(stderr, L"beanlog-ringbench: can't create %ls (error %lu).\n", files.back().c_str(), GetLastError());
+                continue;
+            }
+
+            if (HANDLE producer = Launch(std::format(L"\"{}\" produce {} {}", self, process, messages), file))
+            {
+                running.push_back(producer);
+            }
+            CloseHandle(file);
+        }
+        isSuccess &= running.size() == processes;
+        isSuccess &= Wait(running);
+        const auto elapsed = std::chrono::steady_clock::now() - begin;
+
+        size_t records = 0;
+        for (const std::wstring& file : files)
+        {
+            records += CountRecords(file.c_str());
+        }
+        Report(L"own files", processes, records, expected, elapsed);
+    }
+
+    return isSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    // Started by `Run`, see above
+    if ((argc == 4 || argc == 5) && !wcscmp(argv[1], L"produce"))
+    {
+        return Produce(argc == 5 ? argv[4] : nullptr, wcstoull(argv[2], nullptr, 10), wcstoull(argv[3], nullptr, 10));
+    }
+
+    if (argc <= 3 && (argc < 2 || iswdigit(argv[1][0])) && (argc < 3 || iswdigit(argv[2][0])))
+    {
+        const size_t processes = argc >= 2 ? wcstoull(argv[1], nullptr, 10) : 8;
+        const size_t messages = argc >= 3 ? wcstoull(argv[2], nullptr, 10) : 100000;
+        return processes ? Run(processes, messages) : EXIT_FAILURE;
+    }
+
+    fwprintf(stderr, L"usage: beanlog-ringbench [processes] [messages]\n"
+                     L"       8 processes default to logging 100000 messages each, the logs are written to the\n"
+                     L"       current directory\n");
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,107 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-seek prints the messages of a time window, using the log's sparse index to skip straight to it.
+    The window includes `from` and stops short of `to`.
+ */
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <BeanLog/BeanIndex.hpp>
+
+#include "BeanLines.hpp"
+#include "BeanMappedFile.hpp"
+
+int wmain(int argc, wchar_t** argv)
+{
+    if (argc < 3 || argc > 4)
+    {
+        fwprintf(stderr, L"usage: beanlog-seek <log file> <from> [to]\n"
+                         L"       times look like \"2023-06-01 18:42:07.5\", local unless they end with Z\n");
+        return EXIT_FAILURE;
+    }
+
+    BeanTimeBound from{};
+    BeanTimeBound to{INT64_MAX, INT64_MAX};
+    if (!BeanTimeBound::Parse(argv[2], from) || (argc == 4 && !BeanTimeBound::Parse(argv[3], to)))
+    {
+        fwprintf(stderr, L"beanlog-seek: times look like \"2023-06-01 18:42:07.5\".\n");
+        return EXIT_FAILURE;
+    }
+
+    const BeanMappedFile log(argv[1]);
+    if (!log.IsOpen())
+    {
+        fwprintf(stderr, L"beanlog-seek: can't open %ls (error %lu).\n", argv[1], GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    // The index is mapped at random, the binary search only touches a handful of its pages
+    const BeanMappedFile index((std::wstring(argv[1]) + L".idx").c_str(), FILE_FLAG_RANDOM_ACCESS);
+    std::span<const BeanIndexEntry> entries;
+    BeanIndexHeader header{};
+    if (index.GetSize() >= sizeof(header))
+    {
+        memcpy(&header, index.GetData(), sizeof(header));
+    }
+    if (header.signature == BeanIndexHeader::Signature && header.entrySize == sizeof(BeanIndexEntry))
+    {
+        entries = {reinterpret_cast<const BeanIndexEntry*>(index.GetData() + sizeof(header)), (index.GetSize() - sizeof(header)) / sizeof(BeanIndexEntry)};
+    }
+    else
+    {
+        fwprintf(stderr, L"beanlog-seek: no index next to %ls, reading all of it.\n", argv[1]);
+    }
+
+    const size_t size = log.GetSize();
+    const size_t begin = static_cast<size_t>(std::min<uint64_t>(BeanIndex::Seek(entries, from.utc), size));
+    const size_t end = static_cast<size_t>(std::min<uint64_t>(BeanIndex::SeekEnd(entries, to.utc, size), size));
+
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    std::string buffer;
+    bool isInside = false;
+    BeanLines::ForEachChunk(log.GetData(), begin, std::max(begin, end), [&](std::string_view chunk)
+    {
+        BeanLines::ForEachLine(chunk, [&](std::string_view line)
+        {
+            // Lines without a timestamp belong to the message above them
+            int64_t time = 0;
+            bool isUtc = false;
+            if (BeanLines::GetTime(line, time, isUtc))
+            {
+                isInside = from.IsReached(time, isUtc) && !to.IsReached(time, isUtc);
+            }
+
+            if (!isInside)
+            {
+                return;
+            }
+
+            buffer += line;
+            buffer += '\n';
+            if (buffer.size() >= 64 * 1024)
+            {
+                DWORD written = 0;
+                WriteFile(output, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+                buffer.clear();
+            }
+        });
+    });
+
+    DWORD written = 0;
+    WriteFile(output, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+
+    fwprintf(stderr, L"beanlog-seek: read %llu of %llu bytes.\n", static_cast<unsigned long long>(std::max(begin, end) - begin), static_cast<unsigned long long>(size));
+    return EXIT_SUCCESS;
+}
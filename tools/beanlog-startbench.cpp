@@ -0,0 +1,202 @@
+/*
+    Copyright (C) 2023 GRX78FL (at) Segfault Solutions - MIT License.
+    <https://github.com/GRX78FL>
+    <https://github.com/SegfaultSolutions>
+
+    beanlog-startbench measures what logging adds to an application's time to first frame. Start-up costs are paid
+    once per process, so every run is a fresh process: it logs through its start-up, then presents its first frame.
+    Logging is compiled out of release builds, this one has to be built with `_DEBUG`.
+ */
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <BeanLog/BeanLog.hpp>
+
+#include "BeanMappedFile.hpp"
+
+/* How a run logs, `off` never calls into BeanLog at all. */
+enum class Mode
+{
+    off,
+    sync,
+    async,
+};
+
+static constexpr const wchar_t* ModeNames[] = {L"off", L"sync", L"async"};
+
+/* Stands in for loading a splash screen's resources, the same amount of work whether logging is on or not. */
+static uint64_t Load(size_t step)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        hash = (hash ^ (step + i)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/* What a run appends to the results file, in microseconds. The frame's hash keeps the loading from being optimized out. */
+struct Result
+{
+    int64_t firstMessage;
+    int64_t firstFrame;
+    uint64_t frame;
+};
+
+/* One start-up, appends how long its first message and its first frame took to `results`. */
+static int Start(Mode mode, const wchar_t* results)
+{
+#ifdef _DEBUG
+    const auto begin = std::chrono::steady_clock::now();
+    Result result{};
+
+    if (mode != Mode::off)
+    {
+        if (mode == Mode::async)
+        {
+            bean_set_async(true);
+        }
+        bean_info(L"starting up", kv("mode", ModeNames[static_cast<size_t>(mode)]));
+        result.firstMessage = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    for (size_t step = 0; step < 16; ++step)
+    {
+        result.frame ^= Load(step);
+        if (mode != Mode::off)
+        {
+            bean_info(L"loaded", kv("step", step));
+        }
+    }
+
+    if (mode != Mode::off)
+    {
+        bean_info(L"first frame", kv("frame", result.frame));
+    }
+    result.firstFrame = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    HANDLE file = CreateFileW(results, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    DWORD written = 0;
+    const BOOL isWritten = WriteFile(file, &result, sizeof(result), &written, nullptr) && written == sizeof(result);
+    CloseHandle(file);
+    return isWritten ? EXIT_SUCCESS : EXIT_FAILURE;
+#else
+    (void)mode;
+    (void)results;
+    fwprintf(stderr, L"beanlog-startbench: logging is compiled out of release builds, build with _DEBUG.\n");
+    return EXIT_FAILURE;
+#endif
+}
+
+/* Starts `runs` processes one after the other, each of them appending its `Result` to `results`. */
+static bool Launch(const wchar_t* self, Mode mode, size_t runs, const wchar_t* results)
+{
+    for (size_t run = 0; run < runs; ++run)
+    {
+        std::wstring command = std::format(L"\"{}\" start {} \"{}\"", self, ModeNames[static_cast<size_t>(mode)], results);
+
+        STARTUPINFOW startup{};
+        startup.cb = sizeof(startup);
+        PROCESS_INFORMATION process{};
+        if (!CreateProcessW(nullptr, command.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process))
+        {
+            fwprintf(stderr, L"beanlog-startbench: can't start %ls (error %lu).\n", command.c_str(), GetLastError());
+            return false;
+        }
+
+        DWORD code = EXIT_FAILURE;
+        WaitForSingleObject(process.hProcess, INFINITE);
+        GetExitCodeProcess(process.hProcess, &code);
+        CloseHandle(process.hThread);
+        CloseHandle(process.hProcess);
+        if (code != EXIT_SUCCESS)
+        {
+            fwprintf(stderr, L"beanlog-startbench: run %zu failed.\n", run);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Reports the medians of the runs `results` holds. */
+static bool Report(Mode mode, const wchar_t* results)
+{
+    const BeanMappedFile file(results);
+    if (!file.IsOpen() || file.GetSize() < sizeof(Result))
+    {
+        return false;
+    }
+
+    std::vector<Result> runs(file.GetSize() / sizeof(Result));
+    memcpy(runs.data(), file.GetData(), runs.size() * sizeof(Result));
+
+    std::vector<int64_t> messages;
+    std::vector<int64_t> frames;
+    for (const Result& run : runs)
+    {
+        messages.push_back(run.firstMessage);
+        frames.push_back(run.firstFrame);
+    }
+    std::sort(messages.begin(), messages.end());
+    std::sort(frames.begin(), frames.end());
+
+    fwprintf(stderr, L"%-5ls first message %6lldus, first frame %7lldus (median of %zu runs)\n", ModeNames[static_cast<size_t>(mode)],
+             static_cast<long long>(messages[messages.size() / 2]), static_cast<long long>(frames[frames.size() / 2]), frames.size());
+    return true;
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    // Started by the loop below, see `Start`
+    if (argc == 4 && !wcscmp(argv[1], L"start"))
+    {
+        const std::wstring_view name = argv[2];
+        const auto mode = std::find(std::begin(ModeNames), std::end(ModeNames), name);
+        return mode != std::end(ModeNames) ? Start(static_cast<Mode>(mode - std::begin(ModeNames)), argv[3]) : EXIT_FAILURE;
+    }
+
+    if (argc > 2 || (argc == 2 && !iswdigit(argv[1][0])))
+    {
+        fwprintf(stderr, L"usage: beanlog-startbench [runs] > <log file>\n"
+                         L"       starts 21 processes by default for each of off, sync and async\n");
+        return EXIT_FAILURE;
+    }
+
+    wchar_t self[MAX_PATH];
+    if (!GetModuleFileNameW(nullptr, self, MAX_PATH))
+    {
+        fwprintf(stderr, L"beanlog-startbench: can't find its own path (error %lu).\n", GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    const size_t runs = argc == 2 ? wcstoull(argv[1], nullptr, 10) : 21;
+    for (const Mode mode : {Mode::off, Mode::sync, Mode::async})
+    {
+        const std::wstring results = std::format(L"startbench-{}.bin", ModeNames[static_cast<size_t>(mode)]);
+        DeleteFileW(results.c_str());
+        if (!Launch(self, mode, runs, results.c_str()) || !Report(mode, results.c_str()))
+        {
+            return EXIT_FAILURE;
+        }
+        DeleteFileW(results.c_str());
+    }
+    return EXIT_SUCCESS;
+}